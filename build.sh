@@ -19,4 +19,4 @@
 #
 # Contact Email: gundermanc@gmail.com 
 #
-gcc -std=c99 -g gpac.c ll.c main.c -o gpac
+gcc -std=c99 -g -pthread gpac.c ll.c dirscan.c embed.c delta.c main.c -o gpac
@@ -0,0 +1,581 @@
+/**
+ * GPac File Packaging Library
+ * (C) 2013 Christian Gunderman
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see 
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Contact Email: gundermanc@gmail.com 
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include "delta.h"
+
+// the checksum of no data at all
+#define CHECKSUM_BASIS 14695981039346656037u
+
+// a growable buffer, used to build patch payloads in memory
+typedef struct tagDeltaBuffer {
+  char * data;
+  size_t length;
+  size_t capacity;
+  long lastCopy;
+}DeltaBuffer;
+
+// appends length bytes of data to the end of the buffer
+static void buffer_append(DeltaBuffer * buffer, void * data, size_t length) {
+  if(buffer->length + length > buffer->capacity) {
+    while(buffer->length + length > buffer->capacity)
+      buffer->capacity = buffer->capacity ? buffer->capacity * 2:4096;
+    buffer->data = realloc(buffer->data, buffer->capacity);
+  }
+  memcpy(buffer->data + buffer->length, data, length);
+  buffer->length += length;
+}
+
+// appends a delta op that copies length bytes from offset in the old
+// entry. copies that carry on from the previous one are merged into it.
+static void emit_copy(DeltaBuffer * payload, long offset, long length) {
+  GPACDeltaOp op;
+
+  if(payload->lastCopy >= 0) {
+    GPACDeltaOp * last = (GPACDeltaOp*)(payload->data + payload->lastCopy);
+    if(last->offset + last->length == offset) {
+      last->length += length;
+      return;
+    }
+  }
+
+  op.offset = offset;
+  op.length = length;
+  payload->lastCopy = payload->length;
+  buffer_append(payload, &op, sizeof(GPACDeltaOp));
+}
+
+// appends a delta op holding length literal bytes of new data
+static void emit_literal(DeltaBuffer * payload, unsigned char * data, long length) {
+  GPACDeltaOp op;
+
+  if(length == 0)
+    return;
+
+  op.offset = DELTA_LITERAL;
+  op.length = length;
+  payload->lastCopy = -1;
+  buffer_append(payload, &op, sizeof(GPACDeltaOp));
+  buffer_append(payload, data, length);
+}
+
+// computes the rolling checksum of the DELTA_BLOCK_SIZE bytes at data.
+// a is the sum of the bytes and b the sum of the bytes weighted by
+// their distance from the end of the block, both modulo 2^16.
+static void checksum(unsigned char * data, uint32_t * a, uint32_t * b) {
+  int i;
+
+  *a = *b = 0;
+  for(i = 0; i < DELTA_BLOCK_SIZE; i++) {
+    *a += data[i];
+    *b += (DELTA_BLOCK_SIZE - i) * data[i];
+  }
+  *a &= 0xffff;
+  *b &= 0xffff;
+}
+
+// builds delta ops that turn the old data into the new data, the way
+// rsync does: the old data is split into fixed size blocks indexed by
+// a weak rolling checksum, and a window is rolled over the new data a
+// byte at a time looking for blocks that match. matches are verified
+// with memcmp(), grown in both directions as far as the data agrees,
+// and emitted as copies; everything in between is emitted as literals.
+static void build_delta(unsigned char * oldData, long oldSize, 
+			unsigned char * newData, long newSize,
+			DeltaBuffer * payload) {
+  long blocks = oldSize / DELTA_BLOCK_SIZE, p = 0, literalStart = 0, i;
+  long mask = 1;
+  long * heads, * next;
+  uint32_t * weak, a = 0, b = 0;
+
+  // too small to find blocks in, send it all
+  if(blocks == 0 || newSize < DELTA_BLOCK_SIZE) {
+    emit_literal(payload, newData, newSize);
+    return;
+  }
+
+  // index old blocks by checksum, in a table at least twice their number
+  while(mask < blocks * 2)
+    mask <<= 1;
+  mask--;
+  heads = malloc(sizeof(long) * (mask + 1));
+  next = malloc(sizeof(long) * blocks);
+  weak = malloc(sizeof(uint32_t) * blocks);
+  for(i = 0; i <= mask; i++)
+    heads[i] = -1;
+  for(i = blocks - 1; i >= 0; i--) {
+    checksum(oldData + i * DELTA_BLOCK_SIZE, &a, &b);
+    weak[i] = a | (b << 16);
+    next[i] = heads[weak[i] & mask];
+    heads[weak[i] & mask] = i;
+  }
+
+  // roll a window over the new data looking for old blocks
+  checksum(newData, &a, &b);
+  while(p + DELTA_BLOCK_SIZE <= newSize) {
+    uint32_t sum = a | (b << 16);
+    long match;
+
+    for(match = heads[sum & mask]; match >= 0; match = next[match]) {
+      if(weak[match] == sum && memcmp(oldData + match * DELTA_BLOCK_SIZE,
+				      newData + p, DELTA_BLOCK_SIZE) == 0)
+	break;
+    }
+
+    if(match >= 0) {
+      long offset = match * DELTA_BLOCK_SIZE, length = DELTA_BLOCK_SIZE;
+
+      // grow the match forwards, and backwards into pending literals
+      while(p + length < newSize && offset + length < oldSize
+	    && newData[p + length] == oldData[offset + length])
+	length++;
+      while(p > literalStart && offset > 0 && newData[p - 1] == oldData[offset - 1]) {
+	p--;
+	offset--;
+	length++;
+      }
+
+      emit_literal(payload, newData + literalStart, p - literalStart);
+      emit_copy(payload, offset, length);
+      p += length;
+      literalStart = p;
+      if(p + DELTA_BLOCK_SIZE <= newSize)
+	checksum(newData + p, &a, &b);
+    } else {
+
+      // roll the window on by a byte
+      if(p + DELTA_BLOCK_SIZE < newSize) {
+	uint32_t out = newData[p], in = newData[p + DELTA_BLOCK_SIZE];
+	a = (a - out + in) & 0xffff;
+	b = (b - DELTA_BLOCK_SIZE * out + a) & 0xffff;
+      }
+      p++;
+    }
+  }
+  emit_literal(payload, newData + literalStart, newSize - literalStart);
+
+  free(heads);
+  free(next);
+  free(weak);
+}
+
+// reads the whole of the given entry into newly allocated memory.
+// returns 0 if a read error occurred.
+static unsigned char * read_entry(GPACContext * context, GPACEntryEx entry) {
+  unsigned char * data = malloc(entry.entry.size > 0 ? entry.entry.size:1);
+
+  if(data != 0 && gpac_read_range(context, entry, 0, entry.entry.size, data) 
+     != (size_t)entry.entry.size) {
+    free(data);
+    return 0;
+  }
+  return data;
+}
+
+// adds length bytes of data to a checksum, which is 64 bit FNV-1a and
+// starts out as CHECKSUM_BASIS
+static uint64_t checksum_data(uint64_t checksum, unsigned char * data, 
+			      size_t length) {
+  size_t i;
+
+  for(i = 0; i < length; i++)
+    checksum = (checksum ^ data[i]) * 1099511628211u;
+  return checksum;
+}
+
+// computes the checksum of the old data that the delta ops in the payload
+// copy, in the order that they copy it
+static uint64_t delta_checksum(DeltaBuffer * payload, unsigned char * oldData) {
+  uint64_t checksum = CHECKSUM_BASIS;
+  size_t p = 0;
+
+  while(p < payload->length) {
+    GPACDeltaOp op;
+
+    memcpy(&op, payload->data + p, sizeof(GPACDeltaOp));
+    p += sizeof(GPACDeltaOp);
+    if(op.offset == DELTA_LITERAL)
+      p += op.length;
+    else
+      checksum = checksum_data(checksum, oldData + op.offset, op.length);
+  }
+  return checksum;
+}
+
+// checks whether two entries hold the same bytes, a buffer-full at a time.
+// the checksum of the old entry's data is computed on the way, and is
+// complete if they are the same.
+static bool same_data(GPACContext * oldContext, GPACEntryEx oldEntry,
+		      GPACContext * newContext, GPACEntryEx newEntry,
+		      uint64_t * checksum) {
+  unsigned char oldBuffer[65536], newBuffer[65536];
+  long progress = 0;
+
+  *checksum = CHECKSUM_BASIS;
+  if(oldEntry.entry.size != newEntry.entry.size)
+    return false;
+
+  while(progress < newEntry.entry.size) {
+    size_t read = gpac_read_range(newContext, newEntry, progress, 
+				  sizeof(newBuffer), newBuffer);
+    if(read == 0 || gpac_read_range(oldContext, oldEntry, progress, 
+				    read, oldBuffer) != read
+       || memcmp(oldBuffer, newBuffer, read) != 0)
+      return false;
+    *checksum = checksum_data(*checksum, oldBuffer, read);
+    progress += read;
+  }
+  return true;
+}
+
+// compares two catalog entries by name, and then by volume and address
+// so that the entry added last comes last among equal names
+static int compare_names(const void * a, const void * b) {
+  GPACEntryEx * entryA = (GPACEntryEx*)a, * entryB = (GPACEntryEx*)b;
+  int result = strcmp(entryA->entry.fileName, entryB->entry.fileName);
+
+  if(result != 0)
+    return result;
+  if(entryA->volume != entryB->volume)
+    return entryA->volume < entryB->volume ? -1:1;
+  return entryA->address < entryB->address ? 
+    -1:(entryA->address > entryB->address ? 1:0);
+}
+
+// compares two catalog entries by volume and address only
+static int compare_address(const void * a, const void * b) {
+  GPACEntryEx * entryA = (GPACEntryEx*)a, * entryB = (GPACEntryEx*)b;
+
+  if(entryA->volume != entryB->volume)
+    return entryA->volume < entryB->volume ? -1:1;
+  return entryA->address < entryB->address ? 
+    -1:(entryA->address > entryB->address ? 1:0);
+}
+
+// gets a copy of a context's catalog, sorted with the given function
+static GPACEntryEx * sorted_catalog(GPACContext * context, 
+				    int (*compare)(const void *, const void *)) {
+  int size = gpac_get_size(context);
+  GPACEntryEx * catalog = malloc(sizeof(GPACEntryEx) * (size > 0 ? size:1));
+
+  gpac_get_catalog(context, catalog);
+  qsort(catalog, size, sizeof(GPACEntryEx), compare);
+  return catalog;
+}
+
+// finds the old entry with the same name as the given entry in the old
+// catalog, sorted by compare_names(). when several share the name the
+// last one added is used. every old entry of that name is marked as
+// matched, so that none are listed as removed. returns 0 if none exist.
+static GPACEntryEx * find_old(GPACEntryEx * oldCatalog, int oldSize,
+			      GPACEntryEx * entry, bool * matched) {
+  GPACEntryEx * old = 0;
+  int first = 0, last = oldSize;
+
+  // find the first old entry of the same name
+  while(first < last) {
+    int middle = (first + last) / 2;
+    if(strcmp(oldCatalog[middle].entry.fileName, entry->entry.fileName) < 0)
+      first = middle + 1;
+    else
+      last = middle;
+  }
+
+  // mark all of them, keeping the last
+  for(; first < oldSize && strcmp(oldCatalog[first].entry.fileName, 
+				  entry->entry.fileName) == 0; first++) {
+    matched[first] = true;
+    old = &oldCatalog[first];
+  }
+  return old;
+}
+
+// writes a patch record, followed by length bytes of payload unless
+// payload is 0, in which case the caller writes the payload itself
+static bool write_record(FILE * out, GPACPatchRecord * record, void * payload) {
+  return fwrite(record, 1, sizeof(GPACPatchRecord), out) == sizeof(GPACPatchRecord)
+    && (record->length == 0 || payload == 0
+	|| fwrite(payload, 1, record->length, out) == (size_t)record->length);
+}
+
+// compares the gpacs opened by the two given reader contexts, which
+// must have catalogs, and writes a patch that turns the old one into
+// the new one to patchFileName. entries are matched by name. entries
+// whose data is unchanged are recorded as a copy of the old data, and
+// entries that changed as a binary delta against the old entry of the
+// same name, or in full if the delta would be no smaller. new entries
+// are stored in full, and removed entries are listed by name. copies and
+// deltas record a checksum of the old data they reuse, so that the patch
+// only applies to the same old gpac. the
+// patch lists entries in the order of the new gpac. returns false if
+// a read or write error occurred.
+bool gpac_diff(GPACContext * oldContext, GPACContext * newContext, 
+	       char * patchFileName) {
+  int oldSize = gpac_get_size(oldContext), newSize = gpac_get_size(newContext);
+  GPACEntryEx * oldCatalog = sorted_catalog(oldContext, compare_names);
+  GPACEntryEx * newCatalog = malloc(sizeof(GPACEntryEx) * (newSize > 0 ? newSize:1));
+  bool * matched = calloc(oldSize > 0 ? oldSize:1, sizeof(bool));
+  FILE * out = fopen(patchFileName, "wb");
+  bool retVal = out != 0;
+  GPACPatchHeader header;
+  int i;
+
+  // write patch header, carrying the header of the new gpac
+  memset(&header, 0, sizeof(GPACPatchHeader));
+  strcpy(header.fileType, PATCH_HEADER);
+  memcpy(&header.header, &newContext->header, sizeof(GPACHeader));
+  strcpy(header.header.fileType, FILE_HEADER);
+  retVal = retVal && fwrite(&header, 1, sizeof(GPACPatchHeader), out) 
+    == sizeof(GPACPatchHeader);
+
+  gpac_get_catalog(newContext, newCatalog);
+  for(i = 0; retVal && i < newSize; i++) {
+    GPACEntryEx * old = find_old(oldCatalog, oldSize, &newCatalog[i], matched);
+    GPACPatchRecord record;
+
+    memset(&record, 0, sizeof(GPACPatchRecord));
+    memcpy(&record.entry, &newCatalog[i].entry, sizeof(GPACEntry));
+
+    if(old == 0) {
+
+      // new entry, stored in full
+      record.op = PATCH_ADD;
+      record.length = newCatalog[i].entry.size;
+      retVal = write_record(out, &record, 0) 
+	&& gpac_copy_range(newContext, newCatalog[i], 0, record.length, out)
+	== (size_t)record.length;
+      continue;
+    }
+
+    record.oldVolume = old->volume;
+    record.oldAddress = old->address;
+    record.oldSize = old->entry.size;
+
+    if(same_data(oldContext, *old, newContext, newCatalog[i], 
+		 &record.oldChecksum)) {
+
+      // unchanged entry, copied from the old gpac
+      record.op = PATCH_COPY;
+      retVal = write_record(out, &record, 0);
+    } else {
+      unsigned char * oldData = read_entry(oldContext, *old);
+      unsigned char * newData = read_entry(newContext, newCatalog[i]);
+      DeltaBuffer payload;
+
+      memset(&payload, 0, sizeof(DeltaBuffer));
+      payload.lastCopy = -1;
+
+      if(oldData == 0 || newData == 0)
+	retVal = false;
+      else {
+
+	// changed entry, as a delta if that is smaller
+	build_delta(oldData, old->entry.size, newData, newCatalog[i].entry.size,
+		    &payload);
+	if(payload.length < (size_t)newCatalog[i].entry.size) {
+	  record.op = PATCH_DELTA;
+	  record.length = payload.length;
+	  record.oldChecksum = delta_checksum(&payload, oldData);
+	  retVal = write_record(out, &record, payload.data);
+	} else {
+	  record.op = PATCH_ADD;
+	  record.length = newCatalog[i].entry.size;
+	  retVal = write_record(out, &record, newData);
+	}
+      }
+
+      free(oldData);
+      free(newData);
+      free(payload.data);
+    }
+  }
+
+  // list entries that are no longer present
+  for(i = 0; retVal && i < oldSize; i++) {
+    GPACPatchRecord record;
+
+    if(matched[i])
+      continue;
+    memset(&record, 0, sizeof(GPACPatchRecord));
+    record.op = PATCH_REMOVE;
+    memcpy(&record.entry, &oldCatalog[i].entry, sizeof(GPACEntry));
+    record.oldVolume = oldCatalog[i].volume;
+    record.oldAddress = oldCatalog[i].address;
+    record.oldSize = oldCatalog[i].entry.size;
+    retVal = write_record(out, &record, 0);
+  }
+
+  if(out != 0 && fclose(out) != 0)
+    retVal = false;
+  free(oldCatalog);
+  free(newCatalog);
+  free(matched);
+  return retVal;
+}
+
+// copies length bytes of an old entry's data, starting at offset, to the
+// output a buffer-full at a time, adding them to the checksum on the way.
+// returns the number of bytes copied.
+static long copy_old(GPACContext * context, GPACEntryEx entry, long offset,
+		     long length, FILE * out, uint64_t * checksum) {
+  unsigned char buffer[65536];
+  long copied = 0;
+
+  while(copied < length) {
+    size_t read = gpac_read_range(context, entry, offset + copied, 
+				  length - copied < (long)sizeof(buffer) ? 
+				  length - copied:sizeof(buffer), buffer);
+    if(read == 0 || fwrite(buffer, 1, read, out) != read)
+      break;
+    *checksum = checksum_data(*checksum, buffer, read);
+    copied += read;
+  }
+  return copied;
+}
+
+// copies length bytes of patch payload straight to the output
+static bool copy_payload(FILE * patch, FILE * out, long length) {
+  char buffer[65536];
+
+  while(length > 0) {
+    size_t read = fread(buffer, 1, length < (long)sizeof(buffer) ? 
+			length:sizeof(buffer), patch);
+    if(read == 0 || fwrite(buffer, 1, read, out) != read)
+      return false;
+    length -= read;
+  }
+  return true;
+}
+
+// applies a patch written by gpac_diff() to the gpac opened by the given
+// reader context, which must have a catalog, writing the patched gpac to
+// the new file outFileName. the patch is streamed from start to end, and
+// each byte reused from the old gpac is read once, as it is copied. every
+// old entry the patch refers to must be in the old gpac's catalog with
+// the same name and size, and the data copied from it must have the same
+// checksum as when the patch was made.
+// returns false, and removes any partial output, if the output file
+// already exists, the patch is corrupted or does not match the old gpac,
+// or a read or write error occurred.
+bool gpac_patch(GPACContext * oldContext, char * patchFileName, 
+		char * outFileName) {
+  int oldSize = gpac_get_size(oldContext);
+  GPACEntryEx * oldCatalog = sorted_catalog(oldContext, compare_address);
+  FILE * patch = fopen(patchFileName, "rb"), * out = 0;
+  GPACPatchHeader header;
+  GPACPatchRecord record;
+  bool retVal = patch != 0;
+  int fd = -1;
+
+  // check patch header, and create the output file only if it is new
+  retVal = retVal && fread(&header, 1, sizeof(GPACPatchHeader), patch) 
+    == sizeof(GPACPatchHeader) && strcmp(header.fileType, PATCH_HEADER) == 0;
+  if(retVal && ((fd = open(outFileName, O_WRONLY | O_CREAT | O_EXCL, 0666)) < 0
+		|| (out = fdopen(fd, "wb")) == 0)) {
+    if(fd >= 0)
+      close(fd);
+    fd = -1;
+    retVal = false;
+  }
+  retVal = retVal && fwrite(&header.header, 1, sizeof(GPACHeader), out) 
+    == sizeof(GPACHeader);
+
+  while(retVal && fread(&record, 1, sizeof(GPACPatchRecord), patch) 
+	== sizeof(GPACPatchRecord)) {
+    GPACEntryEx key, * old = 0;
+    long written = 0, consumed = 0;
+    uint64_t oldChecksum = CHECKSUM_BASIS;
+
+    // removed entries are only listed
+    if(record.op == PATCH_REMOVE)
+      continue;
+
+    // find the old entry this one is built from
+    if(record.op == PATCH_COPY || record.op == PATCH_DELTA) {
+      key.volume = record.oldVolume;
+      key.address = record.oldAddress;
+      old = bsearch(&key, oldCatalog, oldSize, sizeof(GPACEntryEx), 
+		    compare_address);
+      if(old == 0 || old->entry.size != record.oldSize
+	 || strcmp(old->entry.fileName, record.entry.fileName) != 0) {
+	retVal = false;
+	break;
+      }
+    }
+
+    if(record.entry.size < 0 || fwrite(&record.entry, 1, sizeof(GPACEntry), out)
+       != sizeof(GPACEntry)) {
+      retVal = false;
+      break;
+    }
+
+    switch(record.op) {
+    case PATCH_COPY:
+      written = copy_old(oldContext, *old, 0, record.entry.size, out, 
+			 &oldChecksum);
+      break;
+    case PATCH_ADD:
+      if(copy_payload(patch, out, record.length))
+	written = record.length;
+      break;
+    case PATCH_DELTA:
+
+      // replay the ops, copying old data and literals in turn
+      while(consumed < record.length) {
+	GPACDeltaOp op;
+
+	if(fread(&op, 1, sizeof(GPACDeltaOp), patch) != sizeof(GPACDeltaOp)
+	   || op.length < 0) 
+	  break;
+	consumed += sizeof(GPACDeltaOp);
+	if(op.offset == DELTA_LITERAL) {
+	  if(!copy_payload(patch, out, op.length))
+	    break;
+	  consumed += op.length;
+	} else if(copy_old(oldContext, *old, op.offset, op.length, out, 
+			   &oldChecksum) != op.length)
+	  break;
+	written += op.length;
+      }
+      if(consumed != record.length)
+	written = -1;
+      break;
+    default:
+      written = -1;
+    }
+
+    // the entry must come out exactly the size it claims to be, from
+    // the same old data as when the patch was made
+    if(written != record.entry.size
+       || (old != 0 && oldChecksum != record.oldChecksum))
+      retVal = false;
+  }
+
+  if(out != 0 && fclose(out) != 0)
+    retVal = false;
+  if(!retVal && out != 0)
+    unlink(outFileName);
+  if(patch != 0)
+    fclose(patch);
+  free(oldCatalog);
+  return retVal;
+}
@@ -0,0 +1,64 @@
+/**
+ * GPac File Packaging Library
+ * (C) 2013 Christian Gunderman
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see 
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Contact Email: gundermanc@gmail.com 
+ */
+
+
+#ifndef DELTA__H__
+#define DELTA__H__
+
+#include <stdint.h>
+#include "gpac.h"
+
+#define PATCH_HEADER "GPac Patch"
+
+#define PATCH_COPY 0
+#define PATCH_ADD 1
+#define PATCH_DELTA 2
+#define PATCH_REMOVE 3
+
+#define DELTA_BLOCK_SIZE 64
+#define DELTA_LITERAL -1
+
+typedef struct tagGPACPatchHeader {
+  char fileType[15];
+  GPACHeader header;
+}GPACPatchHeader;
+
+typedef struct tagGPACPatchRecord {
+  int op;
+  GPACEntry entry;
+  int oldVolume;
+  long oldAddress;
+  long oldSize;
+  uint64_t oldChecksum;
+  long length;
+}GPACPatchRecord;
+
+typedef struct tagGPACDeltaOp {
+  long offset;
+  long length;
+}GPACDeltaOp;
+
+bool gpac_diff(GPACContext * oldContext, GPACContext * newContext, 
+	       char * patchFileName);
+
+bool gpac_patch(GPACContext * oldContext, char * patchFileName, 
+		char * outFileName);
+
+#endif // DELTA__H__
@@ -0,0 +1,304 @@
+/**
+ * Parallel Directory Scanner
+ * (C) 2013 Christian Gunderman
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see 
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Contact Email: gundermanc@gmail.com 
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "dirscan.h"
+
+// joins a directory path and a name with a slash into out. an
+// empty directory or name yields the other one unchanged.
+static void join_path(char * out, char * directory, char * name) {
+  if(directory[0] == '\0')
+    snprintf(out, DIRSCAN_PATH_MAX, "%s", name);
+  else if(name[0] == '\0')
+    snprintf(out, DIRSCAN_PATH_MAX, "%s", directory);
+  else
+    snprintf(out, DIRSCAN_PATH_MAX, "%s/%s", directory, name);
+}
+
+// creates a new, not yet scanned, directory with the given
+// path relative to the scan root
+static DirScanDir * dir_new(char * path) {
+  DirScanDir * dir = (DirScanDir*)calloc(1, sizeof(DirScanDir));
+  dir->path = strdup(path);
+  return dir;
+}
+
+// frees a directory along with the items in it. subdirectories
+// are only freed from index first onwards; the ones before it
+// have already been walked and freed by dirscan_next().
+static void dir_free(DirScanDir * dir, int first) {
+  int i;
+
+  for(i = 0; i < dir->count; i++) {
+    if(i >= first && dir->items[i].dir != 0)
+      dir_free(dir->items[i].dir, 0);
+    free(dir->items[i].name);
+  }
+  free(dir->items);
+  free(dir->path);
+  free(dir);
+}
+
+// compares two directory items by name
+static int compare_items(const void * a, const void * b) {
+  return strcmp(((DirScanItem*)a)->name, ((DirScanItem*)b)->name);
+}
+
+// reads the files and subdirectories of the given directory into its
+// list of items and sorts them by name. entry types come from readdir()
+// where the file system provides them, so most entries need no stat().
+// symbolic links are only followed to regular files, which keeps links
+// back up the tree from causing endless scans. anything other than
+// files and directories is skipped, as are unreadable directories.
+static void scan_dir(DirScan * scan, DirScanDir * dir) {
+  char path[DIRSCAN_PATH_MAX], childPath[DIRSCAN_PATH_MAX];
+  DIR * handle;
+  struct dirent * entry;
+  int capacity = 0;
+
+  join_path(path, scan->root, dir->path);
+  if((handle = opendir(path)) == 0)
+    return;
+
+  while((entry = readdir(handle)) != 0) {
+    bool isDir;
+
+    // skip this directory and its parent
+    if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+
+    // work out what sort of entry this is
+    if(entry->d_type == DT_DIR)
+      isDir = true;
+    else if(entry->d_type == DT_REG)
+      isDir = false;
+    else if(entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+      struct stat info;
+
+      join_path(childPath, path, entry->d_name);
+      if(stat(childPath, &info) != 0)
+	continue;
+      if(S_ISREG(info.st_mode))
+	isDir = false;
+      else if(S_ISDIR(info.st_mode) && entry->d_type == DT_UNKNOWN)
+	isDir = true;
+      else
+	continue;
+    } else
+      continue;
+
+    // grow item list as needed
+    if(dir->count == capacity) {
+      capacity = capacity ? capacity * 2:16;
+      dir->items = (DirScanItem*)realloc(dir->items, capacity * sizeof(DirScanItem));
+    }
+
+    // store item, with a directory to scan later if it is one
+    dir->items[dir->count].name = strdup(entry->d_name);
+    dir->items[dir->count].dir = 0;
+    if(isDir) {
+      join_path(childPath, dir->path, entry->d_name);
+      dir->items[dir->count].dir = dir_new(childPath);
+    }
+    dir->count++;
+  }
+  closedir(handle);
+
+  qsort(dir->items, dir->count, sizeof(DirScanItem), compare_items);
+}
+
+// adds a directory to the back of the queue of directories
+// waiting to be scanned. scan->lock must be held.
+static void enqueue(DirScan * scan, DirScanDir * dir) {
+  dir->nextQueued = 0;
+  if(scan->queueTail != 0)
+    scan->queueTail->nextQueued = dir;
+  else
+    scan->queueHead = dir;
+  scan->queueTail = dir;
+  scan->pending++;
+}
+
+// scanner thread: scans queued directories and queues their
+// subdirectories in turn until the whole tree has been scanned
+// or the scan is stopped.
+static void * scan_worker(void * arg) {
+  DirScan * scan = (DirScan*)arg;
+
+  pthread_mutex_lock(&scan->lock);
+  while(true) {
+    DirScanDir * dir;
+    int i;
+
+    // wait for work while directories are still being scanned
+    while(scan->queueHead == 0 && scan->pending > 0 && !scan->stop)
+      pthread_cond_wait(&scan->changed, &scan->lock);
+    if(scan->queueHead == 0 || scan->stop)
+      break;
+
+    // take the next directory off the queue
+    dir = scan->queueHead;
+    scan->queueHead = dir->nextQueued;
+    if(scan->queueHead == 0)
+      scan->queueTail = 0;
+
+    // scan it without holding the lock
+    pthread_mutex_unlock(&scan->lock);
+    scan_dir(scan, dir);
+    pthread_mutex_lock(&scan->lock);
+
+    // queue its subdirectories and hand it over to dirscan_next()
+    for(i = 0; i < dir->count; i++) {
+      if(dir->items[i].dir != 0)
+	enqueue(scan, dir->items[i].dir);
+    }
+    dir->scanned = true;
+    scan->pending--;
+    pthread_cond_broadcast(&scan->changed);
+  }
+  pthread_mutex_unlock(&scan->lock);
+  return 0;
+}
+
+// pushes a directory onto the stack of directories being walked
+static void push_dir(DirScan * scan, DirScanDir * dir) {
+  if(scan->stackSize == scan->stackCapacity) {
+    scan->stackCapacity = scan->stackCapacity ? scan->stackCapacity * 2:16;
+    scan->stack = (DirScanFrame*)realloc(scan->stack, 
+					 scan->stackCapacity * sizeof(DirScanFrame));
+  }
+  scan->stack[scan->stackSize].dir = dir;
+  scan->stack[scan->stackSize].index = 0;
+  scan->stackSize++;
+}
+
+// starts scanning the directory tree under root with the given number
+// of threads, or one per processor if threads is 0. the threads run
+// ahead of dirscan_next(), reading directories in the background while
+// the caller works through the files already found. returns 0 if root
+// is not a directory.
+DirScan * dirscan_new(char * root, int threads) {
+  DirScan * scan;
+  DirScanDir * dir;
+  struct stat info;
+  size_t rootLen = strlen(root);
+
+  if(stat(root, &info) != 0 || !S_ISDIR(info.st_mode) 
+     || rootLen >= DIRSCAN_PATH_MAX)
+    return 0;
+
+  scan = (DirScan*)calloc(1, sizeof(DirScan));
+  pthread_mutex_init(&scan->lock, 0);
+  pthread_cond_init(&scan->changed, 0);
+
+  // save root without trailing slashes
+  strcpy(scan->root, root);
+  while(rootLen > 1 && scan->root[rootLen - 1] == '/')
+    scan->root[--rootLen] = '\0';
+
+  // the root is the first directory to scan and to walk
+  dir = dir_new("");
+  enqueue(scan, dir);
+  push_dir(scan, dir);
+
+  // start scanner threads
+  if(threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(threads <= 0)
+    threads = 1;
+  if(threads > DIRSCAN_MAX_THREADS)
+    threads = DIRSCAN_MAX_THREADS;
+  for(scan->threadCount = 0; scan->threadCount < threads; scan->threadCount++) {
+    if(pthread_create(&scan->threads[scan->threadCount], 0, scan_worker, scan) != 0)
+      break;
+  }
+
+  // could not start any threads, so scan in this one
+  if(scan->threadCount == 0)
+    scan_worker(scan);
+  return scan;
+}
+
+// gets the next file in the tree. files are returned in a stable order,
+// sorted by name within each directory and with each subdirectory walked
+// in full where its name sorts, whatever order the threads scanned them
+// in. path is set to the path of the file under the root passed to
+// dirscan_new(), and relativePath to its path relative to that root.
+// both are only valid until the next call. returns false once every
+// file has been returned.
+bool dirscan_next(DirScan * scan, char ** path, char ** relativePath) {
+  while(scan->stackSize > 0) {
+    DirScanFrame * frame = &scan->stack[scan->stackSize - 1];
+    DirScanDir * dir = frame->dir;
+    DirScanItem * item;
+
+    // wait for the scanner threads to reach this directory
+    pthread_mutex_lock(&scan->lock);
+    while(!dir->scanned)
+      pthread_cond_wait(&scan->changed, &scan->lock);
+    pthread_mutex_unlock(&scan->lock);
+
+    // finished with this directory, return to its parent
+    if(frame->index >= dir->count) {
+      dir_free(dir, dir->count);
+      scan->stackSize--;
+      continue;
+    }
+
+    // walk into subdirectories, and return files
+    item = &dir->items[frame->index++];
+    if(item->dir != 0) {
+      push_dir(scan, item->dir);
+      continue;
+    }
+    join_path(scan->relativePath, dir->path, item->name);
+    join_path(scan->path, scan->root, scan->relativePath);
+    *path = scan->path;
+    *relativePath = scan->relativePath;
+    return true;
+  }
+  return false;
+}
+
+// stops the scanner threads and frees the scan along with
+// any part of the tree that has not been walked yet
+void dirscan_free(DirScan * scan) {
+  int i;
+
+  // stop and wait for scanner threads
+  pthread_mutex_lock(&scan->lock);
+  scan->stop = true;
+  pthread_cond_broadcast(&scan->changed);
+  pthread_mutex_unlock(&scan->lock);
+  for(i = 0; i < scan->threadCount; i++)
+    pthread_join(scan->threads[i], 0);
+
+  // free directories still being walked, innermost first
+  for(i = scan->stackSize - 1; i >= 0; i--)
+    dir_free(scan->stack[i].dir, scan->stack[i].index);
+
+  pthread_mutex_destroy(&scan->lock);
+  pthread_cond_destroy(&scan->changed);
+  free(scan->stack);
+  free(scan);
+}
@@ -0,0 +1,70 @@
+/**
+ * Parallel Directory Scanner
+ * (C) 2013 Christian Gunderman
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see 
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Contact Email: gundermanc@gmail.com 
+ */
+
+#ifndef DIRSCAN__H__
+#define DIRSCAN__H__
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define DIRSCAN_PATH_MAX 4096
+#define DIRSCAN_MAX_THREADS 16
+
+typedef struct tagDirScanItem {
+  char * name;
+  struct tagDirScanDir * dir;
+}DirScanItem;
+
+typedef struct tagDirScanDir {
+  char * path;
+  bool scanned;
+  DirScanItem * items;
+  int count;
+  struct tagDirScanDir * nextQueued;
+}DirScanDir;
+
+typedef struct tagDirScanFrame {
+  DirScanDir * dir;
+  int index;
+}DirScanFrame;
+
+typedef struct tagDirScan {
+  char root[DIRSCAN_PATH_MAX];
+  pthread_t threads[DIRSCAN_MAX_THREADS];
+  int threadCount;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  DirScanDir * queueHead;
+  DirScanDir * queueTail;
+  int pending;
+  bool stop;
+  DirScanFrame * stack;
+  int stackSize;
+  int stackCapacity;
+  char path[DIRSCAN_PATH_MAX];
+  char relativePath[DIRSCAN_PATH_MAX];
+}DirScan;
+
+DirScan * dirscan_new(char * root, int threads);
+bool dirscan_next(DirScan * scan, char ** path, char ** relativePath);
+void dirscan_free(DirScan * scan);
+#endif //DIRSCAN__H__
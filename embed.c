@@ -0,0 +1,308 @@
+/**
+ * GPac File Packaging Library
+ * (C) 2013 Christian Gunderman
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see 
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Contact Email: gundermanc@gmail.com 
+ */
+
+#include <ctype.h>
+#include "embed.h"
+
+// the source of the hash function, emitted into generated files so the
+// runtime accessor hashes exactly as the generator does. it is 32 bit
+// FNV-1a, with the seed mixed into the offset basis, followed by the
+// murmur3 finalizer: FNV alone leaves the low bits depending only on the
+// low bits of the seed and name, so slots modulo a power of two would
+// collide for every displacement.
+#define EMBED_HASH_SOURCE \
+  "static uint32_t %s_hash(const char * name, uint32_t seed) {\n" \
+  "  uint32_t hash = 2166136261u ^ (seed * 16777619u);\n" \
+  "  while(*name != '\\0')\n" \
+  "    hash = (hash ^ (unsigned char)*name++) * 16777619u;\n" \
+  "  hash = (hash ^ (hash >> 16)) * 0x85ebca6bu;\n" \
+  "  hash = (hash ^ (hash >> 13)) * 0xc2b2ae35u;\n" \
+  "  return hash ^ (hash >> 16);\n" \
+  "}\n\n"
+
+// the same hash function, for use by the generator
+static uint32_t embed_hash(const char * name, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ (seed * 16777619u);
+  while(*name != '\0')
+    hash = (hash ^ (unsigned char)*name++) * 16777619u;
+  hash = (hash ^ (hash >> 16)) * 0x85ebca6bu;
+  hash = (hash ^ (hash >> 13)) * 0xc2b2ae35u;
+  return hash ^ (hash >> 16);
+}
+
+// a bucket of keys sharing a first level hash, and the positions in the
+// catalog of the keys that fall into it
+typedef struct tagEmbedBucket {
+  uint32_t index;
+  int count;
+  int * keys;
+}EmbedBucket;
+
+// catalog being embedded, for the comparison functions below
+static GPACEntryEx * sortCatalog;
+
+// compares two catalog positions by the name of the entry there,
+// and by position for equal names
+static int compare_names(const void * a, const void * b) {
+  int indexA = *(int*)a, indexB = *(int*)b;
+  int result = strcmp(sortCatalog[indexA].entry.fileName, 
+		      sortCatalog[indexB].entry.fileName);
+  return result != 0 ? result:(indexA < indexB ? -1:(indexA > indexB ? 1:0));
+}
+
+// compares two buckets so that the largest come first
+static int compare_buckets(const void * a, const void * b) {
+  int countA = ((EmbedBucket*)a)->count, countB = ((EmbedBucket*)b)->count;
+  return countA > countB ? -1:(countA < countB ? 1:0);
+}
+
+// builds a minimal perfect hash over the names of the count keys listed
+// in keys, using the hash, displace and compress scheme: keys are hashed
+// into buckets of about EMBED_BUCKET_SIZE, and then, largest bucket
+// first, each bucket is given the smallest displacement (a second hash
+// seed) that places all of its keys in free slots. the result maps each
+// key to its own slot with no gaps. slots receives the key in each slot
+// and displacements the displacement of each bucket. returns false if
+// no displacement could be found for some bucket with this seed.
+static bool build_hash(int * keys, int count, uint32_t seed, int bucketCount,
+		       int * slots, uint32_t * displacements) {
+  EmbedBucket * buckets = calloc(bucketCount, sizeof(EmbedBucket));
+  bool * taken = calloc(count, sizeof(bool));
+  int * bucketSlots = malloc(sizeof(int) * (count > 0 ? count:1));
+  bool retVal = true;
+  int i, j, k;
+
+  // hash each key into its bucket
+  for(i = 0; i < bucketCount; i++) {
+    buckets[i].index = i;
+    buckets[i].keys = malloc(sizeof(int) * count);
+  }
+  for(i = 0; i < count; i++) {
+    EmbedBucket * bucket = &buckets[embed_hash(sortCatalog[keys[i]].entry.fileName, 
+					       seed) % bucketCount];
+    bucket->keys[bucket->count++] = keys[i];
+  }
+
+  // place the largest buckets first while there are many free slots
+  qsort(buckets, bucketCount, sizeof(EmbedBucket), compare_buckets);
+  for(i = 0; retVal && i < bucketCount; i++) {
+    EmbedBucket * bucket = &buckets[i];
+    uint32_t d;
+
+    displacements[bucket->index] = 0;
+    if(bucket->count == 0)
+      continue;
+
+    // try displacements until every key lands in a distinct free slot
+    for(d = 1; d < EMBED_MAX_DISPLACEMENT; d++) {
+      for(j = 0; j < bucket->count; j++) {
+	bucketSlots[j] = embed_hash(sortCatalog[bucket->keys[j]].entry.fileName, 
+				    seed + d) % count;
+	if(taken[bucketSlots[j]])
+	  break;
+	for(k = 0; k < j && bucketSlots[k] != bucketSlots[j]; k++);
+	if(k < j)
+	  break;
+      }
+      if(j == bucket->count)
+	break;
+    }
+    if(d == EMBED_MAX_DISPLACEMENT) {
+      retVal = false;
+      break;
+    }
+
+    // claim the slots
+    displacements[bucket->index] = d;
+    for(j = 0; j < bucket->count; j++) {
+      taken[bucketSlots[j]] = true;
+      slots[bucketSlots[j]] = bucket->keys[j];
+    }
+  }
+
+  for(i = 0; i < bucketCount; i++)
+    free(buckets[i].keys);
+  free(buckets);
+  free(taken);
+  free(bucketSlots);
+  return retVal;
+}
+
+// writes a C string literal holding the given name. anything other
+// than letters, digits and a few safe symbols is written as an octal
+// escape, which keeps quotes, backslashes and trigraphs harmless.
+static void write_string(FILE * out, char * name) {
+  fputc('"', out);
+  for(; *name != '\0'; name++) {
+    if(isalnum((unsigned char)*name) || strchr("/._- ", *name) != 0)
+      fputc(*name, out);
+    else
+      fprintf(out, "\\%03o", (unsigned char)*name);
+  }
+  fputc('"', out);
+}
+
+// writes the data of every slot, back to back, as the initializer of an
+// unsigned char array. offsets receives where each slot's data begins.
+// returns false if a read error occurred.
+static bool write_data(GPACContext * in, FILE * out, int * slots, int count,
+		       long * offsets) {
+  unsigned char buffer[65536];
+  long total = 0;
+  int i;
+
+  for(i = 0; i < count; i++) {
+    GPACEntryEx entry = sortCatalog[slots[i]];
+    long progress = 0;
+
+    offsets[i] = total;
+    while(progress < entry.entry.size) {
+      size_t read = gpac_read_range(in, entry, progress, sizeof(buffer), buffer), j;
+      if(read == 0)
+	return false;
+      for(j = 0; j < read; j++, total++)
+	fprintf(out, total % 16 == 15 ? "%u,\n":"%u,", buffer[j]);
+      progress += read;
+    }
+  }
+
+  // an empty array is not valid C
+  if(total == 0)
+    fprintf(out, "0");
+  fprintf(out, "\n");
+  return true;
+}
+
+// writes the gpac opened by the given reader context, which must have a
+// catalog, out as a C source file that compiles the data of every entry
+// into the program. along with the data, a minimal perfect hash over the
+// entry names is computed now, at build time, and emitted with a small
+// accessor function:
+//
+//   bool <symbol>_find(const char * name, const unsigned char ** data,
+//                      size_t * size);
+//
+// which finds an entry with two hashes and one string comparison, with no
+// I/O and no allocation at all. when names repeat, the entry added last
+// is kept, as it is the one extraction would leave behind. returns false
+// if the output file could not be written or the gpac could not be read.
+bool gpac_embed(GPACContext * in, char * outFileName, char * symbol) {
+  int size = gpac_get_size(in), count = 0, i;
+  int bucketCount = size / EMBED_BUCKET_SIZE + 1;
+  GPACEntryEx * catalog = malloc(sizeof(GPACEntryEx) * (size > 0 ? size:1));
+  int * keys = malloc(sizeof(int) * (size > 0 ? size:1));
+  int * slots = malloc(sizeof(int) * (size > 0 ? size:1));
+  long * offsets = malloc(sizeof(long) * (size > 0 ? size:1));
+  uint32_t * displacements = calloc(bucketCount, sizeof(uint32_t));
+  uint32_t seed = 0;
+  FILE * out = 0;
+  bool retVal = true;
+
+  // find the unique names, keeping the last entry of each
+  gpac_get_catalog(in, catalog);
+  sortCatalog = catalog;
+  for(i = 0; i < size; i++)
+    keys[i] = i;
+  qsort(keys, size, sizeof(int), compare_names);
+  for(i = 0; i < size; i++) {
+    if(i + 1 < size && strcmp(catalog[keys[i]].entry.fileName, 
+			      catalog[keys[i + 1]].entry.fileName) == 0)
+      continue;
+    keys[count++] = keys[i];
+  }
+
+  // build the hash, trying new seeds in the unlikely event one fails
+  while(count > 0 && !build_hash(keys, count, seed, bucketCount, 
+				 slots, displacements)) {
+    if(++seed == EMBED_MAX_SEEDS) {
+      retVal = false;
+      break;
+    }
+  }
+
+  if(retVal && (out = fopen(outFileName, "w")) == 0)
+    retVal = false;
+
+  if(retVal) {
+    fprintf(out, "/* generated by gpac embed from '%s'. do not edit. */\n\n",
+	    gpac_get_name(in));
+    fprintf(out, "#include <stdbool.h>\n#include <stddef.h>\n");
+    fprintf(out, "#include <stdint.h>\n#include <string.h>\n\n");
+
+    // entry data, in slot order
+    fprintf(out, "static const unsigned char %s_data[] = {\n", symbol);
+    retVal = write_data(in, out, slots, count, offsets);
+    fprintf(out, "};\n\n");
+  }
+
+  if(retVal) {
+
+    // name, offset and size of each slot
+    fprintf(out, "static const struct {\n  const char * name;\n");
+    fprintf(out, "  size_t offset;\n  size_t size;\n} %s_slots[] = {\n", symbol);
+    for(i = 0; i < count; i++) {
+      fprintf(out, "  { ");
+      write_string(out, catalog[slots[i]].entry.fileName);
+      fprintf(out, ", %ld, %ld },\n", offsets[i], catalog[slots[i]].entry.size);
+    }
+    if(count == 0)
+      fprintf(out, "  { \"\", 0, 0 }\n");
+    fprintf(out, "};\n\n");
+
+    // bucket displacements
+    fprintf(out, "static const uint32_t %s_displacements[] = {\n", symbol);
+    for(i = 0; i < bucketCount; i++)
+      fprintf(out, i % 8 == 7 ? "%u,\n":"%u,", displacements[i]);
+    fprintf(out, "\n};\n\n");
+
+    // runtime accessor
+    fprintf(out, EMBED_HASH_SOURCE, symbol);
+    fprintf(out, "const size_t %s_count = %d;\n\n", symbol, count);
+    fprintf(out, "bool %s_find(const char * name, const unsigned char ** data,\n"
+	    "                 size_t * size) {\n", symbol);
+    if(count == 0) {
+      fprintf(out, "  (void)%s_data;\n  (void)%s_slots;\n", symbol, symbol);
+      fprintf(out, "  (void)%s_displacements;\n  (void)%s_hash;\n", symbol, symbol);
+      fprintf(out, "  (void)name;\n  (void)data;\n  (void)size;\n");
+      fprintf(out, "  return false;\n}\n");
+    }
+  }
+
+  if(retVal && count > 0) {
+    fprintf(out, "  uint32_t bucket, slot;\n\n");
+    fprintf(out, "  bucket = %s_hash(name, %uu) %% %du;\n", symbol, seed, bucketCount);
+    fprintf(out, "  slot = %s_hash(name, %uu + %s_displacements[bucket]) %% %du;\n",
+	    symbol, seed, symbol, count);
+    fprintf(out, "  if(%s_displacements[bucket] == 0\n"
+	    "     || strcmp(%s_slots[slot].name, name) != 0)\n"
+	    "    return false;\n", symbol, symbol);
+    fprintf(out, "  *data = %s_data + %s_slots[slot].offset;\n", symbol, symbol);
+    fprintf(out, "  *size = %s_slots[slot].size;\n  return true;\n}\n", symbol);
+  }
+
+  if(out != 0 && fclose(out) != 0)
+    retVal = false;
+  free(catalog);
+  free(keys);
+  free(slots);
+  free(offsets);
+  free(displacements);
+  return retVal;
+}
@@ -0,0 +1,34 @@
+/**
+ * GPac File Packaging Library
+ * (C) 2013 Christian Gunderman
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see 
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Contact Email: gundermanc@gmail.com 
+ */
+
+
+#ifndef EMBED__H__
+#define EMBED__H__
+
+#include <stdint.h>
+#include "gpac.h"
+
+#define EMBED_BUCKET_SIZE 4
+#define EMBED_MAX_DISPLACEMENT 0x1000000
+#define EMBED_MAX_SEEDS 64
+
+bool gpac_embed(GPACContext * in, char * outFileName, char * symbol);
+
+#endif // EMBED__H__
@@ -18,10 +18,21 @@
  * Contact Email: gundermanc@gmail.com 
  */
 
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <pthread.h>
+#include <time.h>
 #include "gpac.h"
 
 // reads the header from the given input file into the specfied 
-// context. returns false if not successful and true if success.
+// context, followed by the volume header if the file is a volume of
+// a striped gpac. returns false if not successful and true if success.
 static bool read_header(GPACContext * context, FILE * file) {
 
   // return to beginning of file
@@ -29,23 +40,28 @@ static bool read_header(GPACContext * context, FILE * file) {
 
   // read header from file
   if(fread(&context->header, 1, sizeof(GPACHeader), 
-	   file) == sizeof(GPACHeader)) {
-    return true;
-  } else {
+	   file) != sizeof(GPACHeader)) {
     return false;
   }
+
+  // read volume header, if there is one
+  if(strcmp(context->header.fileType, FILE_HEADER_VOLUME) == 0)
+    return fread(&context->volumeHeader, 1, sizeof(GPACVolumeHeader),
+		 file) == sizeof(GPACVolumeHeader);
+  return true;
 }
 
-// opens new or pre-existing gpac for writing. if gpac exists, it may
-// have new files appended to it, but it may not have its header and
-// related information changed and may not have files deleted from
-// inside it. FileName should be the name of a gpac format file to
-// open. If successful, the function returns a new gpac context object
-// that allows insertion of files and setting of title and description
-// and writing of header (for newly opened files only). Returns 0 if
-// the specified file could not be opened for writing, reading, or if
-// the specified file exists and is not a gpac file or is corrupted.
-GPACContext * gpac_writer_new(char * fileName) {
+// gets the address of the first entry of a gpac: the entries follow the
+// header, and the volume header too in the volumes of a striped gpac.
+static long first_entry_address(GPACContext * context) {
+  if(strcmp(context->header.fileType, FILE_HEADER_VOLUME) == 0)
+    return sizeof(GPACHeader) + sizeof(GPACVolumeHeader);
+  return sizeof(GPACHeader);
+}
+
+// opens a new or pre-existing gpac of the given file type for writing,
+// as described for gpac_writer_new().
+static GPACContext * open_writer(char * fileName, char * fileType) {
 
   // allocate a new gpac object
   GPACContext * context = malloc(sizeof(GPACContext));
@@ -62,15 +78,17 @@ GPACContext * gpac_writer_new(char * fileName) {
     if(read_header(context, in)) {
 
       // check for file type: is this a Gundersoft Pac?
-      if(strcmp(context->header.fileType, FILE_HEADER) != 0) {
+      if(strcmp(context->header.fileType, fileType) != 0) {
 	
 	// error! not a Pac, quit
+	fclose(in);
 	free(context);
 	return 0;
       }
     } else {
       
       // error! incorrect file format/read error
+      fclose(in);
       free(context);
       return 0;
     }
@@ -83,13 +101,219 @@ GPACContext * gpac_writer_new(char * fileName) {
 
   // open file for read and write
   if((context->fstream = fopen(fileName, "a+"))) {
+    strcpy(context->header.fileType, fileType);
+    return context;
+  } else {
+    free(context);
+    return 0; // failed
+  }
+}
+
+// creates a new gpac for writing, failing if the file already exists, so
+// that if writing it fails the file can be removed without losing
+// anything. returns 0 if the file exists or could not be created.
+static GPACContext * create_writer(char * fileName) {
+  GPACContext * context;
+  size_t fileNameLen = strlen(fileName);
+  int fd = open(fileName, O_WRONLY | O_CREAT | O_EXCL, 0666);
+  FILE * fstream = fd >= 0 ? fdopen(fd, "wb"):0;
+
+  if(fstream == 0) {
+    if(fd >= 0) {
+      close(fd);
+      unlink(fileName);
+    }
+    return 0; // failed
+  }
+
+  context = malloc(sizeof(GPACContext));
+  memset(context, 0, sizeof(GPACContext));
+  strncpy(context->fileName, fileName, fileNameLen < 255 ? fileNameLen:254);
+  strcpy(context->header.fileType, FILE_HEADER);
+  context->fstream = fstream;
+  return context;
+}
+
+// opens new or pre-existing gpac for writing. if gpac exists, it may
+// have new files appended to it, but it may not have its header and
+// related information changed and may not have files deleted from
+// inside it. FileName should be the name of a gpac format file to
+// open. If successful, the function returns a new gpac context object
+// that allows insertion of files and setting of title and description
+// and writing of header (for newly opened files only). Returns 0 if
+// the specified file could not be opened for writing, reading, or if
+// the specified file exists and is not a gpac file or is corrupted.
+GPACContext * gpac_writer_new(char * fileName) {
+  return open_writer(fileName, FILE_HEADER);
+}
+
+// opens a new or pre-existing gpac for writing in shared mode, which lets
+// several writers, in one process or many, append to the same gpac at
+// once. each entry appended through a shared writer first reserves its
+// space: a short exclusive flock() is taken on the file, an unnamed
+// entry header is written at the end of the file, and the data area
+// behind it is allocated with posix_fallocate(). the lock is released
+// straight away, and the data is then written into the reserved area
+// with positioned writes, in parallel with the other writers. once all
+// of it is written the entry is committed by writing its real header,
+// named, over the unnamed one. readers skip unnamed entries, so they
+// never see a partly written entry, and an entry left unfinished by a
+// writer that died only wastes its space. every writer appending to a
+// gpac at the same time must be a shared writer. returns 0 if the file
+// could not be opened, or exists and is not a gpac.
+GPACContext * gpac_writer_new_shared(char * fileName) {
+  GPACContext * context = malloc(sizeof(GPACContext));
+  size_t fileNameLen = strlen(fileName);
+  int fd;
+
+  // initialize object to zero and save file name
+  memset(context, 0, sizeof(GPACContext));
+  strncpy(context->fileName, fileName, fileNameLen < 255 ? fileNameLen:254);
+  strcpy(context->header.fileType, FILE_HEADER);
+  context->shared = true;
+
+  // open file for positioned reads and writes
+  if((fd = open(fileName, O_RDWR | O_CREAT, 0666)) < 0
+     || (context->fstream = fdopen(fd, "r+b")) == 0) {
+    if(fd >= 0)
+      close(fd);
+    free(context);
+    return 0; // failed
+  }
+
+  // check the header, if some writer has written one
+  flock(fd, LOCK_EX);
+  if(lseek(fd, 0, SEEK_END) > 0) {
+    GPACHeader header;
+
+    if(pread(fd, &header, sizeof(GPACHeader), 0) != sizeof(GPACHeader)
+       || strcmp(header.fileType, FILE_HEADER) != 0) {
+
+      // error! not a Pac, quit
+      flock(fd, LOCK_UN);
+      gpac_destroy(context);
+      return 0;
+    }
+    memcpy(&context->header, &header, sizeof(GPACHeader));
+    context->headerWritten = true;
+  }
+  flock(fd, LOCK_UN);
+  return context;
+}
+
+// opens a new gpac for writing into a growable memory buffer instead of
+// a file. the buffer is allocated and grown as data is written; once the
+// context is destroyed, *buffer points to the finished gpac and *size
+// holds its length, and the caller must free(*buffer). returns 0 if the
+// buffer could not be created.
+GPACContext * gpac_writer_new_memory(char ** buffer, size_t * size) {
+  GPACContext * context = malloc(sizeof(GPACContext));
+
+  memset(context, 0, sizeof(GPACContext));
+  if((context->fstream = open_memstream(buffer, size))) {
     strcpy(context->header.fileType, FILE_HEADER);
     return context;
   } else {
+    free(context);
     return 0; // failed
   }
 }
 
+// builds the name of the given volume of a striped gpac into volumeName.
+// volume 0 is the file name itself; the others are suffixed with their
+// number, so volume 2 of "pack.gpac" is "pack.gpac.2".
+static void volume_name(char * volumeName, char * fileName, int volume) {
+  if(volume == 0)
+    snprintf(volumeName, 270, "%s", fileName);
+  else
+    snprintf(volumeName, 270, "%s.%d", fileName, volume);
+}
+
+static GPACContext * open_reader(FILE * fstream, bool cache);
+
+// checks that a volume header read from a file says that it is the given
+// volume of the striped gpac described by pack.
+static bool is_volume_of(GPACVolumeHeader * pack, GPACVolumeHeader * volume,
+			 int index) {
+  return volume->packId == pack->packId && volume->volume == index
+    && volume->volumeCount == pack->volumeCount;
+}
+
+// opens a new or pre-existing striped gpac for writing. the gpac is split
+// over the given number of volume files, which may be placed on different
+// disks (through symbolic links, for instance) so that reads can use the
+// bandwidth of all of them at once. each volume holds a copy of the header,
+// marked as a volume, followed by a volume header recording a pack id
+// shared by all of the volumes, its own number and the number of volumes,
+// so that readers open exactly the volumes that belong together. each
+// inserted file goes to exactly one volume. with GPAC_STRIPE_ROUND_ROBIN
+// files are dealt out to the volumes in turn; with GPAC_STRIPE_SIZE each
+// file goes to the volume holding the fewest bytes. when the gpac is new,
+// any volume files left over from an earlier gpac of the same name are
+// replaced. if volumes is 0, an existing gpac is opened with the number
+// of volumes recorded in it, and a plain or new one as gpac_writer_new()
+// would. returns 0 if any of the volumes could not be opened, or if the
+// gpac exists and was not striped over the given number of volumes.
+GPACContext * gpac_writer_new_striped(char * fileName, int volumes, int stripe) {
+  GPACContext * context, * volume;
+  char volumeName[270];
+  int i;
+
+  // take the number of volumes from an existing gpac
+  if(volumes == 0 && (volume = open_reader(fopen(fileName, "rb"), false)) != 0) {
+    if(strcmp(volume->header.fileType, FILE_HEADER_VOLUME) == 0)
+      volumes = volume->volumeHeader.volumeCount;
+    gpac_destroy(volume);
+  }
+
+  // a single volume is just a normal gpac
+  if(volumes <= 1)
+    return gpac_writer_new(fileName);
+
+  context = malloc(sizeof(GPACContext));
+  memset(context, 0, sizeof(GPACContext));
+  strcpy(context->header.fileType, FILE_HEADER_VOLUME);
+  context->volumes = calloc(volumes, sizeof(GPACContext*));
+  context->volumeSizes = calloc(volumes, sizeof(long));
+  context->volumeCount = volumes;
+  context->stripe = stripe;
+
+  // open each of the volumes and find how full they already are
+  for(i = 0; i < volumes; i++) {
+    volume_name(volumeName, fileName, i);
+    if(i > 0 && !context->headerWritten)
+      remove(volumeName);
+    if((volume = context->volumes[i] = open_writer(volumeName, 
+						   FILE_HEADER_VOLUME)) == 0) {
+      gpac_destroy(context);
+      return 0; // failed
+    }
+
+    // the header was written if the first volume already existed, and
+    // then it holds the pack id. otherwise a new pack id is made up
+    if(i == 0) {
+      context->headerWritten = volume->headerWritten;
+      context->volumeHeader.packId = context->headerWritten ? 
+	volume->volumeHeader.packId:(unsigned int)time(0) ^ 
+	((unsigned int)getpid() << 16) ^ (unsigned int)clock();
+      context->volumeHeader.volumeCount = volumes;
+    }
+
+    // every volume of an existing gpac must belong to it
+    if(volume->headerWritten != context->headerWritten
+       || (volume->headerWritten && 
+	   !is_volume_of(&context->volumeHeader, &volume->volumeHeader, i))) {
+      gpac_destroy(context);
+      return 0; // failed
+    }
+    volume->volumeHeader = context->volumeHeader;
+    volume->volumeHeader.volume = i;
+    fseek(volume->fstream, 0, SEEK_END);
+    context->volumeSizes[i] = ftell(volume->fstream);
+  }
+  return context;
+}
+
 // gets whether or not GPAC file header has been
 // written. returns true if the header has already
 // been written, and false if it has not.
@@ -103,52 +327,395 @@ bool gpac_is_header_written(GPACContext * context) {
 // gpac. returns true if operation is successful and false
 // if file format is corrupted.
 static bool cache_entries(GPACContext * context) {
-  GPACEntry entry;
-  size_t read;
-
-  // seek to beginning of file
-  fseek(context->fstream, sizeof(GPACHeader), SEEK_SET);
+  GPACEntryIterator i;
+  GPACEntryEx entry;
 
-  // loop through and cache entries as long as more bytes remain
-  while((read = fread(&entry, 1, sizeof(GPACEntry), context->fstream)) != 0) {
+  // loop through and cache entries as long as more remain
+  gpac_entry_iter_get(&i, context);
+  while(gpac_entry_iter_next(&i, &entry)) {
 
-    // "handle improper amount read" errors
-    if(read != sizeof(GPACEntry))
-      return false;
-    
     // create persistant entry; store in list
     GPACEntryEx * persistEntry = (GPACEntryEx*)malloc(sizeof(GPACEntryEx));
-    memcpy(&persistEntry->entry, &entry, sizeof(GPACEntry));
-    persistEntry->address = ftell(context->fstream);
+    memcpy(persistEntry, &entry, sizeof(GPACEntryEx));
     ll_append_void(context->entries, persistEntry);
+  }
+  return !i.error;
+}
 
-    // some brief error checking
-    if(persistEntry->address < sizeof(GPACEntry))
-      return false;
+// builds a reader context around the given stream and reads its
+// header. the catalog is only built if cache is true. returns 0 if
+// the stream could not be opened, is not a gpac or is corrupted.
+static GPACContext * open_reader(FILE * fstream, bool cache) {
+  GPACContext * context;
 
-    // skip over file data to get to next "entry" struct
-    fseek(context->fstream, entry.size, SEEK_CUR);
+  // stream could not be opened
+  if(fstream == 0)
+    return 0;
+
+  context = malloc(sizeof(GPACContext));
+  memset(context, 0, sizeof(GPACContext));
+  context->fstream = fstream;
+
+  // read header, check for file type, and optionally read the catalog.
+  // a volume of a striped gpac may also be read on its own
+  if(cache)
+    context->entries = ll_new();
+  if(!read_header(context, context->fstream)
+     || (strcmp(context->header.fileType, FILE_HEADER) != 0
+	 && strcmp(context->header.fileType, FILE_HEADER_VOLUME) != 0)
+     || (cache && !cache_entries(context))) {
+    gpac_destroy(context);
+    return 0;
   }
-  return true;
+  return context;
+}
+
+// builds a reader context over the size bytes of gpac data at the given
+// address. the memory is used in place, not copied, and must remain
+// valid until the context is destroyed.
+static GPACContext * open_memory_reader(void * data, size_t size, bool cache) {
+  GPACContext * context = open_reader(fmemopen(data, size, "rb"), cache);
+
+  if(context != 0) {
+    context->memory = data;
+    context->memorySize = size;
+  }
+  return context;
 }
 
 // creates a new gpac file reader context with the specfied
 // file name. returns 0 for failure if unable to open the 
 // specified file for reading or if the file is corrupted
 GPACContext * gpac_reader_new(char * fileName) {
-  GPACContext * context = malloc(sizeof(GPACContext));
+  return open_reader(fopen(fileName, "rb"), true);
+}
+
+// creates a lightweight gpac file reader context with the specified
+// file name. only the header is read; no catalog is built, so
+// gpac_get_size() and gpac_get_catalog() report no entries. walk
+// the entries with gpac_entry_iter_get() and gpac_entry_iter_next()
+// instead, which uses constant memory regardless of entry count.
+// returns 0 if unable to open the specified file for reading or if it
+// is not a gpac.
+GPACContext * gpac_reader_open(char * fileName) {
+  return open_reader(fopen(fileName, "rb"), false);
+}
+
+// creates a new gpac reader context over a gpac that is already in
+// memory, such as one embedded in the executable or downloaded into
+// a buffer. the data is not copied and must remain valid until the
+// context is destroyed. returns 0 if the data is not a valid gpac.
+GPACContext * gpac_reader_new_memory(void * data, size_t size) {
+  return open_memory_reader(data, size, true);
+}
+
+// creates a lightweight gpac reader context over a gpac that is already
+// in memory. like gpac_reader_open(), no catalog is built. returns 0 if
+// the data is not a valid gpac.
+GPACContext * gpac_reader_open_memory(void * data, size_t size) {
+  return open_memory_reader(data, size, false);
+}
+
+// gets an iterator positioned at the first entry of a reader context.
+// the iterator reads entries straight from the file as it goes, so
+// it may be used with both lightweight and fully cached contexts.
+void gpac_entry_iter_get(GPACEntryIterator * iterator, GPACContext * context) {
+  iterator->context = context;
+  iterator->volume = 0;
+  iterator->address = first_entry_address(context);
+  iterator->error = false;
+}
+
+// reads the next entry from the file into entry and moves the iterator
+// past its data. the volumes of a striped gpac are walked one after the
+// other. space reserved by shared writers for entries they have not yet
+// committed is skipped. returns false once no entries remain or if the
+// file is corrupted, in which case iterator->error is set to true.
+bool gpac_entry_iter_next(GPACEntryIterator * iterator, GPACEntryEx * entry) {
+  while(!iterator->error) {
+    GPACContext * context = iterator->context;
+    FILE * fstream;
+    size_t read;
+
+    // step through to the volume being walked
+    if(context->volumes != 0) {
+      if(iterator->volume >= context->volumeCount)
+	return false;
+      context = context->volumes[iterator->volume];
+    }
+    fstream = context->fstream;
+
+    // seek to the next "entry" struct; other reads may have moved the cursor
+    fseek(fstream, iterator->address, SEEK_SET);
+
+    // no more bytes remain, move on to the next volume if there is one
+    if((read = fread(&entry->entry, 1, sizeof(GPACEntry), fstream)) == 0) {
+      if(iterator->context->volumes == 0)
+	return false;
+      iterator->volume++;
+      iterator->address = first_entry_address(iterator->context);
+      continue;
+    }
+
+    // "handle improper amount read" errors
+    if(read != sizeof(GPACEntry) || entry->entry.size < 0) {
+      iterator->error = true;
+      return false;
+    }
+
+    // skip over file data to get to next "entry" struct
+    entry->address = iterator->address + sizeof(GPACEntry);
+    entry->volume = iterator->volume;
+    iterator->address = entry->address + entry->entry.size;
+
+    // unnamed entries are reserved space that has not been committed
+    if(entry->entry.fileName[0] != '\0')
+      return true;
+  }
+  return false;
+}
+
+// matches the character c against the bracket expression, such as
+// [a-z] or [!0-9], at the start of *pattern, moving *pattern past it.
+// sets *matched to whether c is in the set. returns false, leaving
+// *pattern alone, if the expression has no closing bracket, in which
+// case the bracket should be matched literally.
+static bool match_class(char ** pattern, char c, bool * matched) {
+  char * p = *pattern + 1;
+  bool negate = *p == '!' || *p == '^';
+
+  *matched = false;
+  if(negate)
+    p++;
+
+  // a leading ']' is part of the set
+  do {
+    if(*p == '\0')
+      return false;
+    if(p[1] == '-' && p[2] != ']' && p[2] != '\0') {
+      if(c >= p[0] && c <= p[2])
+	*matched = true;
+      p += 3;
+    } else {
+      if(c == *p)
+	*matched = true;
+      p++;
+    }
+  } while(*p != ']');
+
+  *matched = *matched != negate && c != '/';
+  *pattern = p + 1;
+  return true;
+}
+
+// the state of a call to gpac_match(): the pattern and name being
+// matched, and a table with a flag for each pair of positions in them
+// that is already known not to match, so that each pair is tried once.
+typedef struct tagGPACMatch {
+  char * pattern;
+  char * name;
+  size_t nameLength;
+  bool * failed;
+}GPACMatch;
+
+static bool match_from(GPACMatch * match, char * pattern, char * name);
+
+// matches the rest of the name against the rest of the pattern, trying
+// each run of characters that a '*' or '**' could match in turn.
+static bool match_rest(GPACMatch * match, char * pattern, char * name) {
+  while(*pattern != '\0') {
+    if(pattern[0] == '*' && pattern[1] == '*') {
+      pattern += 2;
 
+      // "**/" may match no directories
+      if(*pattern == '/' && match_from(match, pattern + 1, name))
+	return true;
+      for(; ; name++) {
+	if(match_from(match, pattern, name))
+	  return true;
+	if(*name == '\0')
+	  return false;
+      }
+    } else if(*pattern == '*') {
+      pattern++;
+      for(; ; name++) {
+	if(match_from(match, pattern, name))
+	  return true;
+	if(*name == '\0' || *name == '/')
+	  return false;
+      }
+    } else if(*pattern == '?') {
+      if(*name == '\0' || *name == '/')
+	return false;
+      pattern++;
+      name++;
+    } else {
+      bool matched;
+
+      if(*pattern == '[' && *name != '\0' && match_class(&pattern, *name, &matched)) {
+	if(!matched)
+	  return false;
+      } else if(*pattern++ != *name)
+	return false;
+      name++;
+    }
+  }
+  return *name == '\0';
+}
+
+// matches the rest of the name against the rest of the pattern, unless
+// the pair of positions is already known not to match.
+static bool match_from(GPACMatch * match, char * pattern, char * name) {
+  bool * failed = &match->failed[(pattern - match->pattern) * 
+				 (match->nameLength + 1) + (name - match->name)];
+
+  if(*failed)
+    return false;
+  if(match_rest(match, pattern, name))
+    return true;
+  *failed = true;
+  return false;
+}
+
+// checks whether an entry name matches the given glob pattern. '?'
+// matches any one character and '*' any run of characters, within one
+// directory of the path; '**' matches any run of characters across
+// directories, so "levels/03/**" matches every entry under levels/03
+// and "**/" may also match no directories at all. [...] matches one
+// character from a set, which may contain ranges and may be negated
+// with '!' or '^'. all other characters match themselves. failed pairs
+// of positions in the pattern and name are remembered, so the time
+// taken is bounded by a polynomial in their lengths however the stars
+// are arranged. returns true if the whole name matches.
+bool gpac_match(char * pattern, char * name) {
+  GPACMatch match;
+  bool retVal;
+
+  match.pattern = pattern;
+  match.name = name;
+  match.nameLength = strlen(name);
+  if((match.failed = calloc((strlen(pattern) + 1) * (match.nameLength + 1),
+			    sizeof(bool))) == 0)
+    return false;
+  retVal = match_from(&match, pattern, name);
+  free(match.failed);
+  return retVal;
+}
+
+// checks whether a name matches any of the given patterns. every
+// name matches when no patterns are given.
+static bool match_any(char ** patterns, int patternCount, char * name) {
+  int i;
+
+  for(i = 0; i < patternCount; i++) {
+    if(gpac_match(patterns[i], name))
+      return true;
+  }
+  return patternCount == 0;
+}
+
+// reads the next entry whose name matches any of the given patterns, as
+// matched by gpac_match(), into entry. only entry headers are read on
+// the way; the data of entries that do not match is skipped over, and
+// matches come back in the order they are stored in the file. returns
+// false once no matching entries remain or if the file is corrupted.
+bool gpac_entry_iter_next_match(GPACEntryIterator * iterator, char ** patterns,
+				int patternCount, GPACEntryEx * entry) {
+  while(gpac_entry_iter_next(iterator, entry)) {
+    if(match_any(patterns, patternCount, entry->entry.fileName))
+      return true;
+  }
+  return false;
+}
+
+// opens every volume of a striped gpac for reading. the first volume is
+// the file itself, and its volume header says how many volumes there are;
+// exactly those are opened, and each must carry the same pack id and its
+// own number. a gpac that is not striped is opened as a normal reader
+// context. the catalog, if built, holds the entries of each volume in
+// turn. returns 0 if a volume is missing, belongs to another gpac, or
+// is corrupted.
+static GPACContext * open_striped_reader(char * fileName, bool cache) {
+  GPACContext * context, * volume;
+  char volumeName[270];
+
+  // open the first volume, which may also be a plain gpac
+  if((volume = open_reader(fopen(fileName, "rb"), false)) == 0)
+    return 0;
+  if(strcmp(volume->header.fileType, FILE_HEADER_VOLUME) != 0) {
+    if(cache) {
+      volume->entries = ll_new();
+      if(!cache_entries(volume)) {
+	gpac_destroy(volume);
+	return 0;
+      }
+    }
+    return volume;
+  }
+
+  // it must be the first volume of the gpac
+  if(volume->volumeHeader.volume != 0 || volume->volumeHeader.volumeCount < 1) {
+    gpac_destroy(volume);
+    return 0;
+  }
+
+  context = malloc(sizeof(GPACContext));
   memset(context, 0, sizeof(GPACContext));
-  context->entries = ll_new();
+  memcpy(&context->header, &volume->header, sizeof(GPACHeader));
+  memcpy(&context->volumeHeader, &volume->volumeHeader, 
+	 sizeof(GPACVolumeHeader));
+  context->volumes = calloc(volume->volumeHeader.volumeCount,
+			    sizeof(GPACContext*));
+  context->volumes[0] = volume;
+  context->volumeCount = 1;
+  if(cache)
+    context->entries = ll_new();
 
-  // open file for reading
-  if((context->fstream = fopen(fileName, "rb"))) {
-    if(!read_header(context, context->fstream) || !cache_entries(context))
+  // open each of the other volumes, and check they belong to this gpac
+  for(; context->volumeCount < context->volumeHeader.volumeCount;
+      context->volumeCount++) {
+    volume_name(volumeName, fileName, context->volumeCount);
+    volume = open_reader(fopen(volumeName, "rb"), false);
+    if(volume == 0 || strcmp(volume->header.fileType, FILE_HEADER_VOLUME) != 0
+       || !is_volume_of(&context->volumeHeader, &volume->volumeHeader,
+			context->volumeCount)) {
+      if(volume != 0)
+	gpac_destroy(volume);
+      gpac_destroy(context);
       return 0;
-    return context;
-  } else {
-    return 0; // failed
+    }
+    context->volumes[context->volumeCount] = volume;
+  }
+
+  // merge the catalogs of the volumes into the shared one
+  if(cache && !cache_entries(context)) {
+    gpac_destroy(context);
+    return 0;
   }
+  return context;
+}
+
+// creates a new reader context over a striped gpac written with
+// gpac_writer_new_striped(), with every volume opened and a shared
+// catalog of all of their entries. entries record which volume they
+// live in, and the extract and read functions use the right one.
+// plain gpacs are opened as gpac_reader_new() would. returns 0 if
+// the gpac could not be opened or is corrupted.
+GPACContext * gpac_reader_new_striped(char * fileName) {
+  return open_striped_reader(fileName, true);
+}
+
+// creates a lightweight reader context over a striped gpac. like
+// gpac_reader_open(), no catalog is built. returns 0 if the gpac
+// could not be opened.
+GPACContext * gpac_reader_open_striped(char * fileName) {
+  return open_striped_reader(fileName, false);
+}
+
+// gets the context that holds the data of the given entry: the volume
+// it lives in for striped gpacs, and the context itself otherwise.
+static GPACContext * volume_of(GPACContext * context, GPACEntryEx entry) {
+  return context->volumes != 0 ? context->volumes[entry.volume]:context;
 }
 
 // writes the file header to the current file
@@ -166,6 +733,36 @@ bool gpac_write_header(GPACContext * context) {
   // mark header as written
   context->headerWritten = true;
 
+  // write the header only if no other shared writer has
+  if(context->shared) {
+    int fd = fileno(context->fstream);
+    bool retVal = false;
+
+    flock(fd, LOCK_EX);
+    if(lseek(fd, 0, SEEK_END) == 0)
+      retVal = pwrite(fd, &context->header, sizeof(GPACHeader), 0) 
+	== sizeof(GPACHeader);
+    flock(fd, LOCK_UN);
+    return retVal;
+  }
+
+  // copy the header to each volume of a striped gpac, followed by
+  // the volume header
+  if(context->volumes != 0) {
+    int i;
+    for(i = 0; i < context->volumeCount; i++) {
+      GPACContext * volume = context->volumes[i];
+
+      memcpy(&volume->header, &context->header, sizeof(GPACHeader));
+      if(!gpac_write_header(volume) 
+	 || fwrite(&volume->volumeHeader, 1, sizeof(GPACVolumeHeader),
+		   volume->fstream) != sizeof(GPACVolumeHeader))
+	return false;
+      context->volumeSizes[i] += sizeof(GPACHeader) + sizeof(GPACVolumeHeader);
+    }
+    return true;
+  }
+
   // write the header to file. fail if unable to write all bytes
   if(fwrite(&context->header, 1, sizeof(GPACHeader),
 	    context->fstream) == sizeof(GPACHeader))
@@ -190,6 +787,99 @@ void gpac_set_description(GPACContext * context, char * description) {
   strncpy(context->header.description, description, len < 45 ? len:44);
 }
 
+// commits the entry reserved by a shared writer by writing its named
+// header over the unnamed one. returns true if successful.
+static bool shared_commit(GPACContext * context) {
+  context->reservedEnd = 0;
+  return pwrite(fileno(context->fstream), &context->reservedEntry, 
+		sizeof(GPACEntry), context->reservedAddress) == sizeof(GPACEntry);
+}
+
+// gives back the space claimed at the given end of a gpac by a reservation
+// that failed. if the file cannot be truncated, the claim is turned into an
+// unnamed entry running to the end of the file instead, which readers skip
+// and later reservations are placed after. returns false if neither worked.
+static bool release_space(int fd, off_t end) {
+  GPACEntry placeholder;
+
+  if(ftruncate(fd, end) == 0)
+    return true;
+  memset(&placeholder, 0, sizeof(GPACEntry));
+  placeholder.size = lseek(fd, 0, SEEK_END) - end - sizeof(GPACEntry);
+  return placeholder.size >= 0
+    && pwrite(fd, &placeholder, sizeof(GPACEntry), end) == sizeof(GPACEntry);
+}
+
+// reserves space at the end of the gpac for a shared writer's next entry,
+// under a short exclusive lock, and writes an unnamed header at its start.
+// the entry is committed once all of its data has been written. returns
+// false if an entry is still being written or the space could not be
+// reserved.
+static bool shared_reserve(GPACContext * context, GPACEntry * entry) {
+  int fd = fileno(context->fstream);
+  GPACEntry placeholder;
+  off_t end;
+  bool retVal;
+
+  // the last entry is not finished yet
+  if(context->reservedEnd != 0)
+    return false;
+
+  memset(&placeholder, 0, sizeof(GPACEntry));
+  placeholder.size = entry->size;
+
+  // claim the end of the file
+  flock(fd, LOCK_EX);
+  end = lseek(fd, 0, SEEK_END);
+  retVal = end >= (off_t)sizeof(GPACHeader)
+    && pwrite(fd, &placeholder, sizeof(GPACEntry), end) == sizeof(GPACEntry)
+    && (entry->size == 0 
+	|| posix_fallocate(fd, end + sizeof(GPACEntry), entry->size) == 0);
+  if(!retVal && end >= (off_t)sizeof(GPACHeader))
+    release_space(fd, end); // give back whatever was claimed
+  flock(fd, LOCK_UN);
+
+  if(!retVal)
+    return false;
+
+  // remember where this entry's data goes
+  memcpy(&context->reservedEntry, entry, sizeof(GPACEntry));
+  context->reservedAddress = end;
+  context->reservedCursor = end + sizeof(GPACEntry);
+  context->reservedEnd = context->reservedCursor + entry->size;
+  return entry->size > 0 || shared_commit(context);
+}
+
+// writes data into the space reserved for a shared writer's current entry,
+// committing the entry once it is full. returns false if the data does not
+// fit the reservation or a write error occurred, in which case the entry
+// is abandoned, uncommitted, and the writer may go on to the next one.
+static bool shared_append_data(GPACContext * context, void * data, size_t length) {
+  int fd = fileno(context->fstream);
+
+  if(context->reservedEnd == 0)
+    return false;
+  if(context->reservedCursor + (long)length > context->reservedEnd) {
+    context->reservedEnd = 0;
+    return false;
+  }
+
+  while(length > 0) {
+    ssize_t written = pwrite(fd, data, length, context->reservedCursor);
+    if(written < 0 && errno == EINTR)
+      continue;
+    if(written <= 0) {
+      context->reservedEnd = 0;
+      return false;
+    }
+    context->reservedCursor += written;
+    data = (char*)data + written;
+    length -= written;
+  }
+
+  return context->reservedCursor < context->reservedEnd || shared_commit(context);
+}
+
 // appends a the specified buffer and amount of data to the gpac. please
 // use gpac_insert_file to replace this functionality. if that function
 // is not adequate for your needs, call gpac_append_entry() with your
@@ -197,6 +887,10 @@ void gpac_set_description(GPACContext * context, char * description) {
 // be careful. improper use of this function will irreversibly corrupt gpacs.
 // returns true if the data was appended, and false if a write error occurred.
 bool gpac_append_data(GPACContext * context, void * data, size_t length) {
+  if(context->volumes != 0)
+    return gpac_append_data(context->volumes[context->activeVolume], data, length);
+  if(context->shared)
+    return shared_append_data(context, data, length);
   if(fwrite(data, 1, length, context->fstream) == length)
     return true;
   else
@@ -208,13 +902,40 @@ bool gpac_append_data(GPACContext * context, void * data, size_t length) {
 // is not adequate for your needs, call this method, and then call 
 // gpac_append_data() with your file data to create a new file in the gpac.
 // be careful. improper use of this function will irreversibly corrupt gpacs.
-// returns true if the data was appended, and false if a write error occurred.
+// returns true if the data was appended, and false if the file name is empty
+// or a write error occurred.
 bool gpac_append_entry(GPACContext * context, char * fileName, size_t fileSize) {
   GPACEntry entry;
   size_t fileNameLen = strlen(fileName);
 
+  // unnamed entries are reserved for space that shared writers have not
+  // yet committed, and are skipped by readers
+  if(fileNameLen == 0)
+    return false;
+
+  // pick the volume of a striped gpac that will hold this file
+  if(context->volumes != 0) {
+    int i;
+    if(context->stripe == GPAC_STRIPE_SIZE) {
+      for(i = 1, context->activeVolume = 0; i < context->volumeCount; i++) {
+	if(context->volumeSizes[i] < context->volumeSizes[context->activeVolume])
+	  context->activeVolume = i;
+      }
+    } else
+      context->activeVolume = context->stripeCursor++ % context->volumeCount;
+    context->volumeSizes[context->activeVolume] += sizeof(GPACEntry) + fileSize;
+    return gpac_append_entry(context->volumes[context->activeVolume], 
+			     fileName, fileSize);
+  }
+
+  // zero the entry so the file name is always null terminated
+  memset(&entry, 0, sizeof(GPACEntry));
   strncpy(entry.fileName, fileName, fileNameLen < 255 ? fileNameLen:254);
   entry.size = fileSize;
+
+  // shared writers reserve space for the entry instead
+  if(context->shared)
+    return shared_reserve(context, &entry);
   return gpac_append_data(context, &entry, sizeof(GPACEntry));
 }
 
@@ -222,15 +943,24 @@ bool gpac_append_entry(GPACContext * context, char * fileName, size_t fileSize)
 // returns true if successful and false if a write or read
 // error occurred.
 bool gpac_insert_file(GPACContext * context, char * fileName) {
-  FILE * in = fopen(fileName, "rb");
+  return gpac_insert_file_as(context, fileName, fileName);
+}
+
+// inserts the specified file into the archive file under a
+// different name, such as a path relative to some directory.
+// returns true if successful and false if a write or read
+// error occurred.
+bool gpac_insert_file_as(GPACContext * context, char * fileName,
+			 char * entryName) {
+  FILE * in;
   bool retVal = true;
 
   // can't write file, no header has been written
   if(context->headerWritten == false)
     return false;
 
-  if(in != 0) {
-    char buffer[15];
+  if((in = fopen(fileName, "rb")) != 0) {
+    char buffer[65536];
     size_t read = 0, fileSize = 0;
 
     // get file size
@@ -239,10 +969,10 @@ bool gpac_insert_file(GPACContext * context, char * fileName) {
     fseek(in, 0, SEEK_SET);
 
     // add an entry header for this file
-    if(gpac_append_entry(context, fileName, fileSize)) {
+    if(gpac_append_entry(context, entryName, fileSize)) {
     
       // while there is data remaining, read in
-      while((read = fread(buffer, 1, 15, in)) != 0) {
+      while((read = fread(buffer, 1, sizeof(buffer), in)) != 0) {
 	
 	// append each buffer-full of data
 	// return false if the data could not be appended
@@ -252,14 +982,20 @@ bool gpac_insert_file(GPACContext * context, char * fileName) {
 	  break;
 	}
       }
+      // a shared writer commits the entry only once its reserved space
+      // is full. if the file came up short, abandon the entry instead
+      if(retVal && context->shared && context->reservedEnd != 0) {
+	context->reservedEnd = 0;
+	retVal = false;
+      }
     } else
       retVal = false;
+
+    // close in file
+    fclose(in);
   } else
     retVal = false;
 
-  // close in file
-  fclose(in);
-
   return retVal;
 }
 
@@ -273,9 +1009,10 @@ bool gpac_insert_data(GPACContext * context, char * fileName,
     gpac_append_data(context, data, fileSize);
 }
 
-// returns the number of files stored in the archive
+// returns the number of files stored in the archive. contexts
+// opened with gpac_reader_open() have no catalog and return 0.
 int gpac_get_size(GPACContext * context) {
-  return ll_size(context->entries);
+  return context->entries != 0 ? ll_size(context->entries):0;
 }
 
 // copies the catalog of entries into an array
@@ -284,6 +1021,10 @@ int gpac_get_size(GPACContext * context) {
 void gpac_get_catalog(GPACContext * context, GPACEntryEx * catalog) {
   LLIterator i;
 
+  // no catalog was built for this context
+  if(context->entries == 0)
+    return;
+
   // get linked list iterator
   ll_iterator_get(&i, context->entries);
   
@@ -297,6 +1038,107 @@ void gpac_get_catalog(GPACContext * context, GPACEntryEx * catalog) {
   }
 }
 
+// starts recording an access trace for a reader context to the specified
+// sidecar file. from then on, the first time each entry is read through
+// gpac_extract_data(), gpac_extract_file(), gpac_read_range() or
+// gpac_read_ranges(), a line holding its volume, address and name is
+// appended to the trace, so the trace lists entries in first-touch order. pass the
+// trace to gpac_repack() to lay the entries out in that order. returns
+// false if the trace file could not be opened or a trace is already
+// being recorded. the trace is locked as entries are recorded, so reads
+// may be made from several threads at once while it is recorded, but it
+// must be started before they begin.
+bool gpac_trace_start(GPACContext * context, char * traceFileName) {
+  if(context->trace != 0 || (context->trace = fopen(traceFileName, "w")) == 0)
+    return false;
+  pthread_mutex_init(&context->traceLock, 0);
+  return true;
+}
+
+// records the given entry in the access trace if tracing is enabled and
+// this is the first time the entry has been read. entries are told apart
+// by volume and address, which are kept in an open addressed hash set.
+// the set and the trace file are only touched under the trace lock.
+static void trace_touch(GPACContext * context, GPACEntryEx entry) {
+  long key = entry.address ^ ((long)entry.volume << 48);
+  int slot;
+
+  if(context->trace == 0)
+    return;
+  pthread_mutex_lock(&context->traceLock);
+
+  // grow the set when it becomes half full, rehashing every address
+  if(context->tracedCount * 2 >= context->tracedCapacity) {
+    long * old = context->traced, * traced;
+    int oldCapacity = context->tracedCapacity, i;
+    int capacity = oldCapacity ? oldCapacity * 2:64;
+
+    if((traced = calloc(capacity, sizeof(long))) != 0) {
+      for(i = 0; i < oldCapacity; i++) {
+	if(old[i] != 0) {
+	  slot = (unsigned long)old[i] * 2654435761u % capacity;
+	  while(traced[slot] != 0)
+	    slot = (slot + 1) % capacity;
+	  traced[slot] = old[i];
+	}
+      }
+      free(old);
+      context->traced = traced;
+      context->tracedCapacity = capacity;
+    } else if(context->tracedCount + 1 >= context->tracedCapacity) {
+
+      // out of memory, and no room left: the entry goes untraced
+      pthread_mutex_unlock(&context->traceLock);
+      return;
+    }
+  }
+
+  // look for the entry, stopping at the first empty slot
+  slot = (unsigned long)key * 2654435761u % context->tracedCapacity;
+  while(context->traced[slot] != 0) {
+    if(context->traced[slot] == key) {
+      pthread_mutex_unlock(&context->traceLock);
+      return; // already touched
+    }
+    slot = (slot + 1) % context->tracedCapacity;
+  }
+
+  // first touch: remember it and write it to the trace
+  context->traced[slot] = key;
+  context->tracedCount++;
+  fprintf(context->trace, "%d\t%ld\t%s\n", entry.volume, entry.address, 
+	  entry.entry.fileName);
+  pthread_mutex_unlock(&context->traceLock);
+}
+
+// copies the entries of the catalog whose names match any of the given
+// patterns, as matched by gpac_match(), into an array, which should be
+// gpac_get_size() * sizeof(GPACEntryEx) in size to be sure of holding
+// them. entries keep the order they are stored in the file, so reading
+// them in turn moves through the gpac in one direction. returns the
+// number of entries copied.
+int gpac_get_catalog_matching(GPACContext * context, char ** patterns,
+			      int patternCount, GPACEntryEx * catalog) {
+  LLIterator i;
+  int count = 0;
+
+  // no catalog was built for this context
+  if(context->entries == 0)
+    return 0;
+
+  // loop through the catalog, copying the matches
+  ll_iterator_get(&i, context->entries);
+  while(ll_iterator_has_next(&i)) {
+    LLValue val;
+
+    if(ll_iterator_pop(&i, &val) 
+       && match_any(patterns, patternCount, 
+		    ((GPACEntryEx*)val.voidVal)->entry.fileName))
+      memcpy(&catalog[count++], val.voidVal, sizeof(GPACEntryEx));
+  }
+  return count;
+}
+
 // extracts chuckSize amount of data from the file specified by the given
 // GPACEntryEx object, starting at offset progress. use in a loop to extract
 // an entire file to a buffer, or use gpac_extract_file() to automatically
@@ -305,6 +1147,10 @@ size_t gpac_extract_data(GPACContext * context, GPACEntryEx entry, void * buffer
 		       size_t chunkSize, size_t * progress) {
   int remaining = (entry.entry.size - *progress);
 
+  // record the access if tracing
+  trace_touch(context, entry);
+  context = volume_of(context, entry);
+
   // move to file data offset
   fseek(context->fstream, entry.address += *(progress), SEEK_SET);
 
@@ -318,6 +1164,186 @@ size_t gpac_extract_data(GPACContext * context, GPACEntryEx entry, void * buffer
 	    remaining:chunkSize, context->fstream);
 }
 
+// reads into the given buffers starting at offset in the file, using as
+// few preadv() calls as possible. short reads are resumed until the
+// buffers are full or the end of the file is reached. the iovec array
+// is consumed in the process. returns the number of bytes read.
+static size_t read_vector(int fd, struct iovec * iov, int count, off_t offset) {
+  size_t total = 0;
+
+  while(count > 0) {
+    ssize_t read = preadv(fd, iov, count > IOV_MAX ? IOV_MAX:count, offset);
+
+    // retry interrupted reads, stop on errors and end of file
+    if(read < 0 && errno == EINTR)
+      continue;
+    if(read <= 0)
+      break;
+
+    total += read;
+    offset += read;
+
+    // skip past the buffers that were filled, and trim a partial one
+    while(count > 0 && (size_t)read >= iov->iov_len) {
+      read -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if(count > 0) {
+      iov->iov_base = (char*)iov->iov_base + read;
+      iov->iov_len -= read;
+    }
+  }
+  return total;
+}
+
+// clamps a range to the bounds of its entry. returns the number of
+// bytes of the range that lie within the entry.
+static size_t clamp_range(GPACEntryEx entry, long offset, size_t length) {
+  if(offset < 0 || offset >= entry.entry.size)
+    return 0;
+  return length < (size_t)(entry.entry.size - offset) ? 
+    length:(size_t)(entry.entry.size - offset);
+}
+
+// reads into the given buffers starting at offset in the gpac. reads
+// come straight from memory for memory backed contexts, and from the
+// file otherwise. returns the number of bytes read.
+static size_t read_at(GPACContext * context, struct iovec * iov, int count, 
+		      off_t offset) {
+  size_t total = 0;
+  int i;
+
+  if(context->memory == 0)
+    return read_vector(fileno(context->fstream), iov, count, offset);
+
+  // copy each buffer-full of data until the end of the gpac
+  for(i = 0; i < count && offset < context->memorySize; i++) {
+    size_t length = context->memorySize - offset < iov[i].iov_len ?
+      context->memorySize - offset:iov[i].iov_len;
+    memcpy(iov[i].iov_base, context->memory + offset, length);
+    total += length;
+    offset += length;
+  }
+  return total;
+}
+
+// reads length bytes, starting offset bytes into the file specified by
+// the given GPACEntryEx object, into buffer. unlike gpac_extract_data()
+// this keeps no progress state, moves no file cursor and does not zero
+// the buffer, so any part of any entry may be read at any time. ranges
+// extending past the end of the entry are truncated. returns the number
+// of bytes read.
+size_t gpac_read_range(GPACContext * context, GPACEntryEx entry, long offset,
+		       size_t length, void * buffer) {
+  struct iovec iov;
+
+  // record the access if tracing
+  trace_touch(context, entry);
+
+  iov.iov_base = buffer;
+  iov.iov_len = clamp_range(entry, offset, length);
+  return iov.iov_len == 0 ? 
+    0:read_at(volume_of(context, entry), &iov, 1, entry.address + offset);
+}
+
+// copies length bytes, starting offset bytes into the file specified by
+// the given GPACEntryEx object, to the current position of the out
+// stream. when both sides are files the kernel copies the data with
+// copy_file_range(), which on many file systems shares or clones the
+// blocks instead of moving them through user space; otherwise, or if
+// the kernel cannot copy between the two, the data goes through a
+// buffer. ranges extending past the end of the entry are truncated.
+// returns the number of bytes copied.
+size_t gpac_copy_range(GPACContext * context, GPACEntryEx entry, long offset,
+		       size_t length, FILE * out) {
+  GPACContext * volume = volume_of(context, entry);
+  char buffer[65536];
+  size_t total = 0;
+
+  // record the access if tracing
+  trace_touch(context, entry);
+  length = clamp_range(entry, offset, length);
+
+  // let the kernel copy between the files, keeping out's position in step
+  if(volume->memory == 0 && fileno(out) >= 0 && fflush(out) == 0) {
+    loff_t inOffset = entry.address + offset;
+
+    while(total < length) {
+      ssize_t copied = copy_file_range(fileno(volume->fstream), &inOffset, 
+				       fileno(out), 0, length - total, 0);
+      if(copied < 0 && errno == EINTR)
+	continue;
+      if(copied <= 0)
+	break;
+      total += copied;
+    }
+    fseek(out, lseek(fileno(out), 0, SEEK_CUR), SEEK_SET);
+  }
+
+  // copy whatever is left through the buffer
+  while(total < length) {
+    struct iovec iov;
+    size_t read;
+
+    iov.iov_base = buffer;
+    iov.iov_len = length - total < sizeof(buffer) ? length - total:sizeof(buffer);
+    read = read_at(volume, &iov, 1, entry.address + offset + total);
+    if(read == 0 || fwrite(buffer, 1, read, out) != read)
+      break;
+    total += read;
+  }
+  return total;
+}
+
+// reads each of the given ranges into its buffer, as gpac_read_range()
+// does, and stores the number of bytes read for each in its read field.
+// ranges that follow on from one another in the file, such as
+// neighbouring chunks of one entry or the end of one entry and the
+// start of the next, are gathered into a single preadv() call. returns
+// the total number of bytes read, or 0 if out of memory.
+size_t gpac_read_ranges(GPACContext * context, GPACRange * ranges, int count) {
+  struct iovec * iov = malloc(sizeof(struct iovec) * (count > 0 ? count:1));
+  size_t total = 0;
+  int i = 0;
+
+  if(iov == 0)
+    return 0;
+
+  while(i < count) {
+    off_t start = ranges[i].entry.address + ranges[i].offset;
+    off_t end = start;
+    size_t read;
+    int first = i, n = 0;
+
+    // gather ranges for as long as they are contiguous in the file
+    do {
+      trace_touch(context, ranges[i].entry);
+      iov[n].iov_base = ranges[i].buffer;
+      iov[n].iov_len = clamp_range(ranges[i].entry, ranges[i].offset, 
+				   ranges[i].length);
+      end += iov[n].iov_len;
+      n++;
+      i++;
+    } while(i < count && ranges[i].entry.volume == ranges[first].entry.volume
+	    && ranges[i].entry.address + ranges[i].offset == end);
+
+    // read the run and hand out the bytes read to each of its ranges
+    read = end == start ? 
+      0:read_at(volume_of(context, ranges[first].entry), iov, n, start);
+    total += read;
+    for(; first < i; first++) {
+      size_t length = clamp_range(ranges[first].entry, ranges[first].offset,
+				  ranges[first].length);
+      ranges[first].read = read < length ? read:length;
+      read -= ranges[first].read;
+    }
+  }
+
+  free(iov);
+  return total;
+}
+
 // gets the size of the specified file entry
 size_t gpac_file_size(GPACEntryEx entry) {
   return entry.entry.size;
@@ -333,11 +1359,48 @@ char * gpac_get_description(GPACContext * context) {
   return context->header.description;
 }
 
+// checks that an entry name stays inside the directory it is extracted
+// to: it must not be an absolute path, or have a ".." component. names
+// stored from a directory tree are always relative, but a downloaded
+// gpac could hold any name.
+static bool is_safe_name(char * fileName) {
+  char * component = fileName;
+
+  if(*fileName == '/')
+    return false;
+  for(; ; component++) {
+    if(component[0] == '.' && component[1] == '.' 
+       && (component[2] == '/' || component[2] == '\0'))
+      return false;
+    if((component = strchr(component, '/')) == 0)
+      return true;
+  }
+}
+
+// opens the named file for writing, first creating any directories
+// in its path that do not exist yet, so that entries stored with
+// relative paths extract into the same tree they came from.
+static FILE * create_file(char * fileName) {
+  char path[255];
+  char * slash;
+
+  snprintf(path, sizeof(path), "%s", fileName);
+  for(slash = strchr(path + 1, '/'); slash != 0; slash = strchr(slash + 1, '/')) {
+    *slash = '\0';
+    mkdir(path, 0777);
+    *slash = '/';
+  }
+  return fopen(fileName, "wb");
+}
+
 // extracts the file described by the given GPACEntryEx object from
-// the gpac_get_catalog() function.
+// the gpac_get_catalog() function. unless overrideFileName is given,
+// entries whose names are absolute or contain a ".." component are
+// not extracted, and 0 is returned.
 size_t gpac_extract_file(GPACContext * context, GPACEntryEx entry, 
 			 char * overrideFileName) {
-  FILE * out = fopen(overrideFileName ? overrideFileName:entry.entry.fileName, "wb");
+  FILE * out = overrideFileName ? create_file(overrideFileName):
+    (is_safe_name(entry.entry.fileName) ? create_file(entry.entry.fileName):0);
   size_t written = 0;
   if(out != 0) {
     
@@ -348,7 +1411,6 @@ size_t gpac_extract_file(GPACContext * context, GPACEntryEx entry,
     // to the external file
     while((read = gpac_extract_data(context, entry, 
 				    buffer, 4, &progress)) != 0) {
-      buffer[read] ='\0';                        // null terminator
       written += fwrite(buffer, 1, read, out);   // write data
     }
 
@@ -358,6 +1420,214 @@ size_t gpac_extract_file(GPACContext * context, GPACEntryEx entry,
   return written;
 }
 
+// state shared by the threads of gpac_extract_all()
+typedef struct tagGPACExtractJob {
+  GPACContext * context;
+  int volume;
+  char ** patterns;
+  int patternCount;
+  void (*extracted)(GPACEntryEx entry);
+  pthread_t thread;
+  bool threaded;
+  bool retVal;
+}GPACExtractJob;
+
+// extracts every matching entry of one volume to a file of the same
+// name, reading with positioned reads so each volume may be serviced
+// by a thread of its own. sets job->retVal to false if the volume is
+// corrupted, or an entry could not be written or has a name that would
+// write outside the current directory.
+static void * extract_volume(void * arg) {
+  GPACExtractJob * job = arg;
+  GPACContext * volume = job->context->volumes != 0 ?
+    job->context->volumes[job->volume]:job->context;
+  GPACEntryIterator i;
+  GPACEntryEx entry;
+  char buffer[65536];
+
+  gpac_entry_iter_get(&i, volume);
+  while(gpac_entry_iter_next_match(&i, job->patterns, job->patternCount, &entry)) {
+    FILE * out = is_safe_name(entry.entry.fileName) ? 
+      create_file(entry.entry.fileName):0;
+    long progress = 0;
+    bool written = true;
+
+    entry.volume = job->volume;
+    if(out == 0) {
+      job->retVal = false;
+      continue;
+    }
+
+    // the trace is shared by all volumes
+    trace_touch(job->context, entry);
+
+    // copy the data over one buffer-full at a time
+    while(progress < entry.entry.size) {
+      size_t read = gpac_read_range(volume, entry, progress, 
+				    sizeof(buffer), buffer);
+      if(read == 0 || fwrite(buffer, 1, read, out) != read) {
+	written = job->retVal = false;
+	break;
+      }
+      progress += read;
+    }
+    fclose(out);
+
+    if(written && job->extracted != 0)
+      job->extracted(entry);
+  }
+
+  if(i.error)
+    job->retVal = false;
+  return 0;
+}
+
+// extracts every file in the gpac to a file of the same name. the
+// volumes of a striped gpac are each read by an I/O thread of their
+// own, so extraction runs at the combined speed of the disks holding
+// them. extracted, if not 0, is called after each file is written,
+// from whichever thread wrote it. the catalog is not needed, so
+// contexts opened with gpac_reader_open_striped() work well here.
+// returns false if a volume is corrupted or a file could not be written.
+bool gpac_extract_all(GPACContext * context, void (*extracted)(GPACEntryEx entry)) {
+  return gpac_extract_matching(context, 0, 0, extracted);
+}
+
+// extracts the files in the gpac whose names match any of the given
+// patterns, as matched by gpac_match(), in the same way as
+// gpac_extract_all(). each volume is walked in file order reading
+// only entry headers until a match is found, so only the data of the
+// matching entries is read. entries whose names are absolute or contain
+// a ".." component are skipped. returns false if a volume is corrupted,
+// a file could not be written, or an entry was skipped.
+bool gpac_extract_matching(GPACContext * context, char ** patterns,
+			   int patternCount, void (*extracted)(GPACEntryEx entry)) {
+  int count = context->volumes != 0 ? context->volumeCount:1, i;
+  GPACExtractJob * jobs = calloc(count, sizeof(GPACExtractJob));
+  bool retVal = true;
+
+  // start a thread per volume
+  for(i = 0; i < count; i++) {
+    jobs[i].context = context;
+    jobs[i].volume = i;
+    jobs[i].patterns = patterns;
+    jobs[i].patternCount = patternCount;
+    jobs[i].extracted = extracted;
+    jobs[i].retVal = true;
+    jobs[i].threaded = count > 1 && 
+      pthread_create(&jobs[i].thread, 0, extract_volume, &jobs[i]) == 0;
+    if(!jobs[i].threaded)
+      extract_volume(&jobs[i]); // extract in this thread instead
+  }
+
+  // wait for all of them to finish
+  for(i = 0; i < count; i++) {
+    if(jobs[i].threaded)
+      pthread_join(jobs[i].thread, 0);
+    retVal = retVal && jobs[i].retVal;
+  }
+
+  free(jobs);
+  return retVal;
+}
+
+// compares two catalog entries by their volume and address in the gpac
+static int compare_address(const void * a, const void * b) {
+  GPACEntryEx * entryA = (GPACEntryEx*)a, * entryB = (GPACEntryEx*)b;
+  if(entryA->volume != entryB->volume)
+    return entryA->volume < entryB->volume ? -1:1;
+  return entryA->address < entryB->address ? 
+    -1:(entryA->address > entryB->address ? 1:0);
+}
+
+// copies the data of the given entry from one gpac to the end of another,
+// one buffer-full at a time. returns true if successful and false if a
+// read or write error occurred.
+static bool copy_entry(GPACContext * in, GPACContext * out, GPACEntryEx entry) {
+  char buffer[65536];
+  long progress = 0;
+
+  if(!gpac_append_entry(out, entry.entry.fileName, entry.entry.size))
+    return false;
+
+  while(progress < entry.entry.size) {
+    size_t read = gpac_read_range(in, entry, progress, sizeof(buffer), buffer);
+    if(read == 0 || !gpac_append_data(out, buffer, read))
+      return false;
+    progress += read;
+  }
+  return true;
+}
+
+// rewrites the gpac opened by the given reader context, which must have
+// been created with gpac_reader_new() or gpac_reader_new_striped(), to
+// a new single volume gpac file called
+// outFileName. entries listed in the access trace written by
+// gpac_trace_start() come first, in first-touch order, so that entries
+// which are used together end up next to each other and cold start
+// reads become mostly sequential. the remaining entries follow in their
+// original order. trace lines that do not match an entry in this gpac
+// are ignored. returns false, and removes any partial output, if the
+// trace could not be opened, the output file already exists, or a read
+// or write error occurred.
+bool gpac_repack(GPACContext * in, char * outFileName, char * traceFileName) {
+  int size = gpac_get_size(in), i;
+  GPACEntryEx * catalog = malloc(sizeof(GPACEntryEx) * (size > 0 ? size:1));
+  bool * placed = calloc(size > 0 ? size:1, sizeof(bool));
+  FILE * trace = fopen(traceFileName, "r");
+  GPACContext * out = trace != 0 ? create_writer(outFileName):0;
+  bool retVal = out != 0;
+  char line[512];
+
+  // copy the header to the new gpac, which is never striped
+  if(retVal) {
+    memcpy(&out->header, &in->header, sizeof(GPACHeader));
+    strcpy(out->header.fileType, FILE_HEADER);
+    retVal = gpac_write_header(out);
+  }
+
+  // sort catalog by address so trace lines can be looked up
+  gpac_get_catalog(in, catalog);
+  qsort(catalog, size, sizeof(GPACEntryEx), compare_address);
+
+  // copy traced entries first, in first-touch order
+  while(retVal && fgets(line, sizeof(line), trace) != 0) {
+    GPACEntryEx key, * match;
+    char * name;
+    int length = 0;
+
+    if(sscanf(line, "%d\t%ld\t%n", &key.volume, &key.address, &length) != 2
+       || length == 0)
+      continue;
+    name = line + length;
+    name[strcspn(name, "\r\n")] = '\0';
+
+    match = bsearch(&key, catalog, size, sizeof(GPACEntryEx), compare_address);
+    if(match != 0 && !placed[match - catalog]
+       && strcmp(match->entry.fileName, name) == 0) {
+      placed[match - catalog] = true;
+      retVal = copy_entry(in, out, *match);
+    }
+  }
+
+  // copy everything else in its original order
+  for(i = 0; retVal && i < size; i++) {
+    if(!placed[i])
+      retVal = copy_entry(in, out, catalog[i]);
+  }
+
+  if(trace != 0)
+    fclose(trace);
+  if(out != 0) {
+    gpac_destroy(out);
+    if(!retVal)
+      unlink(outFileName);
+  }
+  free(catalog);
+  free(placed);
+  return retVal;
+}
+
 // destroys a gpac context and releases all associated
 // resources and closes any open files.
 void gpac_destroy(GPACContext * context) {
@@ -368,6 +1638,24 @@ void gpac_destroy(GPACContext * context) {
     fclose(context->fstream);
   }
 
+  // release volumes of a striped gpac
+  if(context->volumes != 0) {
+    int i;
+    for(i = 0; i < context->volumeCount; i++) {
+      if(context->volumes[i] != 0)
+	gpac_destroy(context->volumes[i]);
+    }
+    free(context->volumes);
+    free(context->volumeSizes);
+  }
+
+  // release access trace
+  if(context->trace != 0) {
+    fclose(context->trace);
+    pthread_mutex_destroy(&context->traceLock);
+  }
+  free(context->traced);
+
   // release entries list objects
   if(context->entries != 0) {
     ll_iterator_get(&i, context->entries);
@@ -24,9 +24,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include "ll.h"
 
 #define FILE_HEADER "Gundersoft Pac"
+#define FILE_HEADER_VOLUME "Gundersoft Vol"
+
+#define GPAC_STRIPE_ROUND_ROBIN 0
+#define GPAC_STRIPE_SIZE 1
 
 typedef struct tagGPACFileHeader {
   char fileType[15];
@@ -34,6 +39,12 @@ typedef struct tagGPACFileHeader {
   char description[45];
 }GPACHeader;
 
+typedef struct tagGPACVolumeHeader {
+  unsigned int packId;
+  int volume;
+  int volumeCount;
+}GPACVolumeHeader;
+
 typedef struct tagGPACFileEntry {
   char fileName[255];
   long size;
@@ -42,24 +53,84 @@ typedef struct tagGPACFileEntry {
 typedef struct tagGPACFileEntryEx {
   GPACEntry entry;
   long address;
+  int volume;
 }GPACEntryEx;
 
+typedef struct tagGPACRange {
+  GPACEntryEx entry;
+  long offset;
+  size_t length;
+  void * buffer;
+  size_t read;
+}GPACRange;
+
 typedef struct tagGPACContext {
   bool headerWritten;
   char fileName[255];
   GPACHeader header;
+  GPACVolumeHeader volumeHeader;
   FILE * fstream;
+  char * memory;
+  size_t memorySize;
   LL * entries;
+  FILE * trace;
+  long * traced;
+  int tracedCount;
+  int tracedCapacity;
+  pthread_mutex_t traceLock;
+  struct tagGPACContext ** volumes;
+  long * volumeSizes;
+  int volumeCount;
+  int activeVolume;
+  int stripeCursor;
+  int stripe;
+  bool shared;
+  GPACEntry reservedEntry;
+  long reservedAddress;
+  long reservedCursor;
+  long reservedEnd;
 }GPACContext;
 
+typedef struct tagGPACEntryIterator {
+  GPACContext * context;
+  int volume;
+  long address;
+  bool error;
+}GPACEntryIterator;
+
 
 
 GPACContext * gpac_writer_new(char * fileName);
 
+GPACContext * gpac_writer_new_memory(char ** buffer, size_t * size);
+
+GPACContext * gpac_writer_new_striped(char * fileName, int volumes, int stripe);
+
+GPACContext * gpac_writer_new_shared(char * fileName);
+
 bool gpac_is_header_written(GPACContext * context);
 
 GPACContext * gpac_reader_new(char * fileName);
 
+GPACContext * gpac_reader_open(char * fileName);
+
+GPACContext * gpac_reader_new_memory(void * data, size_t size);
+
+GPACContext * gpac_reader_open_memory(void * data, size_t size);
+
+GPACContext * gpac_reader_new_striped(char * fileName);
+
+GPACContext * gpac_reader_open_striped(char * fileName);
+
+void gpac_entry_iter_get(GPACEntryIterator * iterator, GPACContext * context);
+
+bool gpac_entry_iter_next(GPACEntryIterator * iterator, GPACEntryEx * entry);
+
+bool gpac_match(char * pattern, char * name);
+
+bool gpac_entry_iter_next_match(GPACEntryIterator * iterator, char ** patterns,
+				int patternCount, GPACEntryEx * entry);
+
 bool gpac_write_header(GPACContext * context);
 
 void gpac_set_name(GPACContext * context, char * name);
@@ -72,6 +143,9 @@ bool gpac_append_entry(GPACContext * context, char * fileName, size_t fileSize);
 
 bool gpac_insert_file(GPACContext * context, char * fileName);
 
+bool gpac_insert_file_as(GPACContext * context, char * fileName,
+			 char * entryName);
+
 bool gpac_insert_data(GPACContext * context, char * fileName, 
 		      void * data, long fileSize);
 
@@ -79,9 +153,24 @@ int gpac_get_size(GPACContext * context);
 
 void gpac_get_catalog(GPACContext * context, GPACEntryEx * catalog);
 
+int gpac_get_catalog_matching(GPACContext * context, char ** patterns,
+			      int patternCount, GPACEntryEx * catalog);
+
 size_t gpac_extract_data(GPACContext * context, GPACEntryEx entry, void * buffer, 
 		       size_t chunkSize, size_t * progress) ;
 
+size_t gpac_read_range(GPACContext * context, GPACEntryEx entry, long offset,
+		       size_t length, void * buffer);
+
+size_t gpac_read_ranges(GPACContext * context, GPACRange * ranges, int count);
+
+size_t gpac_copy_range(GPACContext * context, GPACEntryEx entry, long offset,
+		       size_t length, FILE * out);
+
+bool gpac_trace_start(GPACContext * context, char * traceFileName);
+
+bool gpac_repack(GPACContext * in, char * outFileName, char * traceFileName);
+
 size_t gpac_file_size(GPACEntryEx entry);
 
 char * gpac_get_name(GPACContext * context);
@@ -91,6 +180,11 @@ char * gpac_get_description(GPACContext * context);
 size_t gpac_extract_file(GPACContext * context, GPACEntryEx entry, 
 			 char * overrideFileName);
 
+bool gpac_extract_all(GPACContext * context, void (*extracted)(GPACEntryEx entry));
+
+bool gpac_extract_matching(GPACContext * context, char ** patterns,
+			   int patternCount, void (*extracted)(GPACEntryEx entry));
+
 void gpac_destroy(GPACContext * context);
 
 
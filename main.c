@@ -25,26 +25,61 @@ static void print_help() {
   printf("%s", "\r\nGPackager v1.0 (C) 2013 Christian Gunderman\r\n");
   printf("%s", "Subject to GNU GPL <http://www.gnu.org/licenses/>\r\n\r\n");
   printf("%s", "USAGE:\r\n");
-  printf("%s", " gpac create [archive_file] [name] [description] [files_to_put_in...]\r\n");
-  printf("%s", " gpac add [archive_file] [files_to_put_in...]\r\n");
-  printf("%s", " gpac extract [archive_file]\r\n");
+  printf("%s", " gpac create [-v volumes] [-s] [-r directory] [archive_file] [name] [description] [files_to_put_in...]\r\n");
+  printf("%s", " gpac add [-m] [archive_file] [files_to_put_in...]\r\n");
+  printf("%s", " gpac extract [archive_file] [--trace trace_file] [--match pattern...]\r\n");
   printf("%s", " gpac info [archive_file]\r\n");
+  printf("%s", " gpac repack [archive_file] [new_archive_file] --profile [trace_file]\r\n");
+  printf("%s", " gpac embed [archive_file] [c_file] [symbol]\r\n");
+  printf("%s", " gpac diff [old_archive_file] [new_archive_file] [patch_file]\r\n");
+  printf("%s", " gpac patch [old_archive_file] [patch_file] [new_archive_file]\r\n");
   printf("%s", "\r\n");
+  printf("%s", "OPTIONS:\r\n");
+  printf("%s", " -v volumes    stripe the archive over several volume files\r\n");
+  printf("%s", " -s            stripe by size rather than round robin\r\n");
+  printf("%s", " -r directory  add every file under directory, named relative to it\r\n");
+  printf("%s", " -m            let several gpac add processes append at once\r\n");
+  printf("%s", "\r\n");
+}
+
+// prints the name of each extracted file
+static void print_extracted(GPACEntryEx entry) {
+  printf("GPAC: Extracted '%s'\r\n", entry.entry.fileName);
 }
 
 // command line program entry point
 int main(int argc, char * argv[]) {
 
-  if(argc > 3 && strcmp(argv[1], "create") == 0) {
-    int i = 0;
+  if(argc > 2 && strcmp(argv[1], "create") == 0) {
+    int i = 2, volumes = 1, stripe = GPAC_STRIPE_ROUND_ROBIN;
+    char * directory = 0;
+    GPACContext * out;
+
+    // read options
+    for(; i < argc && argv[i][0] == '-'; i++) {
+      if(strcmp(argv[i], "-v") == 0 && i + 1 < argc)
+	volumes = atoi(argv[++i]);
+      else if(strcmp(argv[i], "-s") == 0)
+	stripe = GPAC_STRIPE_SIZE;
+      else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+	directory = argv[++i];
+      else {
+	print_help();
+	return 1;
+      }
+    }
+    if(argc - i < 3) {
+      print_help();
+      return 1;
+    }
 
     // create GPAC context
-    GPACContext * out = gpac_writer_new(argv[2]);
+    out = gpac_writer_new_striped(argv[i], volumes, stripe);
     if(out != 0) {
 
       // set attributes
-      gpac_set_name(out, argv[3]);
-      gpac_set_description(out, argv[4]);
+      gpac_set_name(out, argv[i + 1]);
+      gpac_set_description(out, argv[i + 2]);
 
       // write file header (this will fail if file exists
       if(!gpac_write_header(out)) {
@@ -53,11 +88,29 @@ int main(int argc, char * argv[]) {
       }
 
       // add files if any were given
-      for(i = 5; i < argc; i++) {
+      for(i += 3; i < argc; i++) {
 	if(!gpac_insert_file(out, argv[i]))
 	  printf("GPAC: Unable to add file '%s'\r\n", argv[i]);
       }
 
+      // add the directory tree, if given, while it is still being scanned
+      if(directory != 0) {
+	DirScan * scan = dirscan_new(directory, 0);
+	char * path, * relativePath;
+
+	if(scan == 0) {
+	  printf("GPAC: Unable to read directory '%s'\r\n", directory);
+	  gpac_destroy(out);
+	  return 2;
+	}
+	while(dirscan_next(scan, &path, &relativePath)) {
+	  if(strlen(relativePath) >= sizeof(((GPACEntry*)0)->fileName)
+	     || !gpac_insert_file_as(out, path, relativePath))
+	    printf("GPAC: Unable to add file '%s'\r\n", path);
+	}
+	dirscan_free(scan);
+      }
+
       // destroy GPAC context
       gpac_destroy(out);
     } else {
@@ -65,10 +118,13 @@ int main(int argc, char * argv[]) {
       return 2;
     } 
   } else if(argc > 2 && strcmp(argv[1], "add") == 0) {
-    int i = 0;
+    bool shared = argc > 3 && strcmp(argv[2], "-m") == 0;
+    int i = shared ? 3:2;
 
-    // create GPAC context
-    GPACContext * out = gpac_writer_new(argv[2]);
+    // create GPAC context. files added to a striped gpac go to the
+    // volume holding the fewest bytes
+    GPACContext * out = shared ? gpac_writer_new_shared(argv[i]):
+      gpac_writer_new_striped(argv[i], 0, GPAC_STRIPE_SIZE);
     if(out != 0) {
 
       // write file information header
@@ -78,7 +134,7 @@ int main(int argc, char * argv[]) {
       }
 
       // add files
-      for(i = 3; i < argc; i++) {
+      for(i++; i < argc; i++) {
 	if(!gpac_insert_file(out, argv[i]))
 	  printf("GPAC: Unable to add file '%s'\r\n", argv[i]);
       }
@@ -92,37 +148,56 @@ int main(int argc, char * argv[]) {
     } 
 
   } else if(argc > 2 && strcmp(argv[1], "extract") == 0) {
-    GPACContext * in = gpac_reader_new(argv[2]);
+    char ** patterns = (char**)malloc(sizeof(char*) * argc), * trace = 0;
+    int i, patternCount = 0;
+    GPACContext * in;
+
+    // read options
+    for(i = 3; i < argc; i += 2) {
+      if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+	trace = argv[i + 1];
+      else if(strcmp(argv[i], "--match") == 0 && i + 1 < argc)
+	patterns[patternCount++] = argv[i + 1];
+      else {
+	free(patterns);
+	print_help();
+	return 1;
+      }
+    }
+
+    in = gpac_reader_open_striped(argv[2]);
     if(in != 0) {
+      bool extracted;
 
-      // alloc space for catalog
-      GPACEntryEx * catalog = (GPACEntryEx*)malloc(sizeof(GPACEntryEx) * gpac_get_size(in));
-      int i = 0;
-      
-      // get the catalog
-      gpac_get_catalog(in, catalog);
-    
-      for(i = 0; i < gpac_get_size(in); i++) {
-	gpac_extract_file(in, catalog[i], 0);
-	printf("GPAC: Extracted '%s'\r\n", catalog[i].entry.fileName);
+      // record the order entries are read in, if requested
+      if(trace != 0 && !gpac_trace_start(in, trace)) {
+	printf("GPAC: Unable to open trace file '%s' for writing.\r\n", trace);
+	free(patterns);
+	gpac_destroy(in);
+	return 6;
       }
 
-      // free catalog
-      free(catalog);
-      
+      // extract each matching entry as it is read, a thread per volume
+      extracted = gpac_extract_matching(in, patterns, patternCount, print_extracted);
+
       // free GPAC context
+      free(patterns);
       gpac_destroy(in);
+
+      if(!extracted) {
+	printf("GPAC: Unable to extract all of package '%s'.\r\n", argv[2]);
+	return 5;
+      }
     } else {
       printf("GPAC: Unable to open '%s' package for reading.\r\n", argv[2]);
+      free(patterns);
       return 4;
     }
   } else if(argc == 3 && strcmp(argv[1], "info") == 0) {
-    GPACContext * in = gpac_reader_new(argv[2]);
+    GPACContext * in = gpac_reader_open_striped(argv[2]);
     if(in != 0) {
-
-      // alloc space for catalog
-      GPACEntryEx * catalog = (GPACEntryEx*)malloc(sizeof(GPACEntryEx) * gpac_get_size(in));
-      int i = 0;
+      GPACEntryIterator i;
+      GPACEntryEx entry;
 
       // print file information
       printf("Package Name: %s\r\n", gpac_get_name(in));
@@ -130,18 +205,96 @@ int main(int argc, char * argv[]) {
       
       printf("%s", "Files:\r\n");
 
-      // get the catalog
-      gpac_get_catalog(in, catalog);
-    
-      for(i = 0; i < gpac_get_size(in); i++) {
-	printf("  '%s'\r\n", catalog[i].entry.fileName);
+      // print each entry as it is read from the package
+      gpac_entry_iter_get(&i, in);
+      while(gpac_entry_iter_next(&i, &entry)) {
+	printf("  '%s'\r\n", entry.entry.fileName);
       }
 
-      // free catalog
-      free(catalog);
-      
       // free GPAC context
       gpac_destroy(in);
+
+      if(i.error) {
+	printf("GPAC: Package '%s' is corrupted.\r\n", argv[2]);
+	return 5;
+      }
+    } else {
+      printf("GPAC: Unable to open '%s' package for reading.\r\n", argv[2]);
+      return 4;
+    }
+  } else if(argc == 6 && strcmp(argv[1], "repack") == 0 
+	    && strcmp(argv[4], "--profile") == 0) {
+    GPACContext * in = gpac_reader_new_striped(argv[2]);
+    if(in != 0) {
+
+      // rewrite the package in first-use order
+      if(!gpac_repack(in, argv[3], argv[5])) {
+	printf("GPAC: Unable to repack '%s' into '%s'.\r\n", argv[2], argv[3]);
+	gpac_destroy(in);
+	return 7;
+      }
+
+      // free GPAC context
+      gpac_destroy(in);
+    } else {
+      printf("GPAC: Unable to open '%s' package for reading.\r\n", argv[2]);
+      return 4;
+    }
+  } else if(argc == 5 && strcmp(argv[1], "embed") == 0) {
+    GPACContext * in = gpac_reader_new_striped(argv[2]);
+    if(in != 0) {
+
+      // write the package out as C source
+      if(!gpac_embed(in, argv[3], argv[4])) {
+	printf("GPAC: Unable to embed '%s' into '%s'.\r\n", argv[2], argv[3]);
+	gpac_destroy(in);
+	return 8;
+      }
+
+      // free GPAC context
+      gpac_destroy(in);
+    } else {
+      printf("GPAC: Unable to open '%s' package for reading.\r\n", argv[2]);
+      return 4;
+    }
+  } else if(argc == 5 && strcmp(argv[1], "diff") == 0) {
+    GPACContext * old = gpac_reader_new_striped(argv[2]);
+    GPACContext * in = gpac_reader_new_striped(argv[3]);
+    if(old != 0 && in != 0) {
+
+      // write the differences between the packages
+      if(!gpac_diff(old, in, argv[4])) {
+	printf("GPAC: Unable to write patch '%s'.\r\n", argv[4]);
+	gpac_destroy(old);
+	gpac_destroy(in);
+	return 9;
+      }
+
+      // free GPAC contexts
+      gpac_destroy(old);
+      gpac_destroy(in);
+    } else {
+      printf("GPAC: Unable to open '%s' package for reading.\r\n", 
+	     old == 0 ? argv[2]:argv[3]);
+      if(old != 0)
+	gpac_destroy(old);
+      if(in != 0)
+	gpac_destroy(in);
+      return 4;
+    }
+  } else if(argc == 5 && strcmp(argv[1], "patch") == 0) {
+    GPACContext * old = gpac_reader_new_striped(argv[2]);
+    if(old != 0) {
+
+      // build the new package from the old one and the patch
+      if(!gpac_patch(old, argv[3], argv[4])) {
+	printf("GPAC: Unable to apply patch '%s' to '%s'.\r\n", argv[3], argv[2]);
+	gpac_destroy(old);
+	return 10;
+      }
+
+      // free GPAC context
+      gpac_destroy(old);
     } else {
       printf("GPAC: Unable to open '%s' package for reading.\r\n", argv[2]);
       return 4;
@@ -21,3 +21,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "gpac.h"
+#include "dirscan.h"
+#include "embed.h"
+#include "delta.h"